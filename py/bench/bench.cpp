@@ -0,0 +1,245 @@
+/*
+ * bench.cpp
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+// Benchmarks Stretch over synthetic audio and a WAV file, sweeping crispness,
+// ratio, block size (0 meaning auto) and channel count, and writes one JSON record per run:
+// realtime factor, ns per input sample, and the calls to and bytes from C++ operator new
+// made by the call.  Those cover this code's allocations but not RubberBand's own, which go
+// through malloc / posix_memalign and are not counted.  Each record has a cold figure, from
+// a first call made with the stretcher pool emptied so it pays for building the stretcher
+// as a one-shot caller does, and a warm best of N reusing it.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <algorithm>
+#include <getopt.h>
+#include <sndfile.h>
+
+#include "stretch.hpp"
+#include "pool.hpp"
+
+static std::atomic<bool> counting(false);
+static std::atomic<unsigned long> nNewCalls(0);
+static std::atomic<unsigned long> nNewBytes(0);
+
+void * operator new(size_t n) {
+	if(counting) {
+		nNewCalls++;
+		nNewBytes+=n;
+	}
+	auto p=malloc(n);
+	if(p==nullptr) throw std::bad_alloc();
+	return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p,size_t) noexcept { free(p); }
+
+struct Input {
+	std::string name;
+	int rate;
+	std::vector<float> mono;
+};
+
+// A few seconds of partials, a slow chirp and bursts of noise, so that every
+// crispness level has transients and tones to work on.
+
+static Input synthetic(const int rate,const double seconds) {
+	Input input { "synthetic", rate, std::vector<float>((size_t)(rate*seconds)) };
+	unsigned seed=1;
+	for(size_t i=0;i<input.mono.size();i++) {
+		auto t=double(i)/rate;
+		double x=0.2*sin(2*M_PI*220*t)+0.1*sin(2*M_PI*660*t)+0.1*sin(2*M_PI*(300+200*t)*t);
+		if(fmod(t,0.5)<0.02) {
+			seed=seed*1103515245+12345;
+			x+=0.3*(double((seed>>8)&0xffff)/32768.0-1.0);
+		}
+		input.mono[i]=(float)x;
+	}
+	return input;
+}
+
+static Input wavFile(const std::string &path) {
+	SF_INFO info;
+	memset(&info,0,sizeof(SF_INFO));
+	auto file=sf_open(path.c_str(),SFM_READ,&info);
+	if(file==nullptr) throw std::runtime_error("Cannot open " + path);
+	std::vector<float> frames(info.frames*info.channels);
+	auto got=sf_readf_float(file,frames.data(),info.frames);
+	sf_close(file);
+	Input input { path, info.samplerate, std::vector<float>(got) };
+	for(sf_count_t i=0;i<got;i++) input.mono[i]=frames[i*info.channels];
+	return input;
+}
+
+static std::vector<float> interleaved(const Input &input,const unsigned channels) {
+	std::vector<float> out(input.mono.size()*channels);
+	for(size_t i=0;i<input.mono.size();i++) {
+		for(unsigned c=0;c<channels;c++) out[i*channels+c]=input.mono[i]*(1.0f-0.1f*c);
+	}
+	return out;
+}
+
+struct Timing {
+	double seconds;
+	unsigned long newCalls;
+	unsigned long newBytes;
+};
+
+struct Run {
+	unsigned block;
+	unsigned long framesOut;
+	Timing cold;
+	Timing warm;
+};
+
+static Timing once(const std::vector<float> &samples,const unsigned channels,const int rate,
+		const Stretch::Options options,const double ratio,const unsigned block,Run &run) {
+	auto frames=samples.size()/channels;
+	nNewCalls=0;
+	nNewBytes=0;
+	auto start=std::chrono::steady_clock::now();
+	counting=true;
+	{
+		Stretch st(frames,channels,rate,ratio,options);
+		st.setBlockSize(block);
+		run.framesOut=st(samples.data(),frames).size()/channels;
+		run.block=st.blockSize();
+	}
+	counting=false;
+	std::chrono::duration<double> elapsed=std::chrono::steady_clock::now()-start;
+	return { elapsed.count(), nNewCalls, nNewBytes };
+}
+
+static Run run(const std::vector<float> &samples,const unsigned channels,const int rate,
+		const int crispness,const double ratio,const unsigned block,const unsigned repeats) {
+	auto options=Stretch::makeOptions(crispness,false,true) | RB::OptionThreadingNever;
+	auto &pool=StretcherPool::shared();
+	auto capacity=pool.stats().capacity;
+	pool.resize(0);
+	pool.resize(capacity);
+
+	Run result { block, 0, {}, { 1.0e30, 0, 0 } };
+	result.cold=once(samples,channels,rate,options,ratio,block,result);
+	for(unsigned r=0;r<repeats;r++) {
+		auto t=once(samples,channels,rate,options,ratio,block,result);
+		if(t.seconds<result.warm.seconds) result.warm=t;
+	}
+	return result;
+}
+
+static std::vector<double> numbers(const std::string &list) {
+	std::vector<double> out;
+	std::istringstream fields(list);
+	std::string field;
+	while(std::getline(fields,field,',')) out.push_back(std::stod(field));
+	return out;
+}
+
+static struct option opts[] = {
+		{ "wav",       required_argument, 0, 'w' },
+		{ "seconds",   required_argument, 0, 's' },
+		{ "repeats",   required_argument, 0, 'n' },
+		{ "crispness", required_argument, 0, 'c' },
+		{ "ratios",    required_argument, 0, 'r' },
+		{ "blocks",    required_argument, 0, 'b' },
+		{ "channels",  required_argument, 0, 'C' },
+		{ 0,0,0,0 }
+};
+
+int main(int argc,char **argv) {
+	std::string wav="tests/slugs.wav";
+	double seconds=5.0;
+	unsigned repeats=3;
+	std::vector<double> crispness { 0, 1, 2, 3, 4, 5, 6 };
+	std::vector<double> ratios { 0.5, 0.8, 1.25, 2.0 };
+	std::vector<double> blocks { 256, 1024, 4096, 16384, Stretch::AutoBlockSize };
+	std::vector<double> channelCounts { 1, 2 };
+
+	int optionIndex = 0;
+	while(true) {
+		auto c=getopt_long(argc,argv,"w:s:n:c:r:b:C:",opts,&optionIndex);
+		if(c == -1) break;
+		switch(c) {
+		case 'w':
+			wav=optarg;
+			break;
+		case 's':
+			seconds=std::stod(optarg);
+			break;
+		case 'n':
+			repeats=std::max(1,std::stoi(optarg));
+			break;
+		case 'c':
+			crispness=numbers(optarg);
+			break;
+		case 'r':
+			ratios=numbers(optarg);
+			break;
+		case 'b':
+			blocks=numbers(optarg);
+			break;
+		case 'C':
+			channelCounts=numbers(optarg);
+			break;
+		default:
+			std::cerr << "Usage: " << argv[0] << " [--wav FILE] [--seconds S] [--repeats N] [--crispness LIST]"
+					<< " [--ratios LIST] [--blocks LIST] [--channels LIST]" << std::endl;
+			return 2;
+		}
+	}
+
+	std::vector<Input> inputs { synthetic(44100,seconds) };
+	try {
+		if(!wav.empty()) inputs.push_back(wavFile(wav));
+	}
+	catch(std::exception &e) {
+		std::cerr << "Skipping: " << e.what() << std::endl;
+	}
+
+	std::cout << "[" << std::endl;
+	bool first=true;
+	for(auto &input : inputs) {
+		for(auto ch : channelCounts) {
+			unsigned channels=(unsigned)ch;
+			auto samples=interleaved(input,channels);
+			auto frames=input.mono.size();
+			for(auto block : blocks) {
+				for(auto c : crispness) {
+					for(auto ratio : ratios) {
+						auto r=run(samples,channels,input.rate,(int)c,ratio,(unsigned)block,repeats);
+						auto audio=double(frames)/input.rate;
+						if(!first) std::cout << "," << std::endl;
+						first=false;
+						std::cout << "  { \"input\": \"" << input.name << "\", \"rate\": " << input.rate
+								<< ", \"channels\": " << channels << ", \"block\": " << r.block
+								<< ", \"auto\": " << ((block==Stretch::AutoBlockSize) ? "true" : "false")
+								<< ", \"crispness\": " << (int)c << ", \"ratio\": " << ratio
+								<< ", \"frames_in\": " << frames << ", \"frames_out\": " << r.framesOut;
+						for(auto &t : { std::make_pair("cold",r.cold), std::make_pair("warm",r.warm) }) {
+							std::cout << ", \"" << t.first << "\": { \"seconds\": " << t.second.seconds
+									<< ", \"realtime\": " << audio/t.second.seconds
+									<< ", \"ns_per_sample\": " << 1.0e9*t.second.seconds/(frames*channels)
+									<< ", \"new_calls\": " << t.second.newCalls
+									<< ", \"new_bytes\": " << t.second.newBytes << " }";
+						}
+						std::cout << " }";
+					}
+				}
+			}
+		}
+	}
+	std::cout << std::endl << "]" << std::endl;
+	return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * files.cpp
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include <cstring>
+#include <map>
+#include <algorithm>
+#include <stdexcept>
+#include "files.hpp"
+
+unsigned long SndfileSource::read(float *data,const unsigned long frames) {
+	auto count=sf_readf_float(file,data,frames);
+	return (count>0) ? count : 0;
+}
+
+void SndfileSource::rewind() {
+	if(sf_seek(file,0,SEEK_SET)<0) throw std::runtime_error("Cannot seek back to start of input");
+}
+
+static const std::map<std::string,int> Subtypes = {
+	{ "PCM_U8", SF_FORMAT_PCM_U8 },
+	{ "PCM_S8", SF_FORMAT_PCM_S8 },
+	{ "PCM_16", SF_FORMAT_PCM_16 },
+	{ "PCM_24", SF_FORMAT_PCM_24 },
+	{ "PCM_32", SF_FORMAT_PCM_32 },
+	{ "FLOAT", SF_FORMAT_FLOAT },
+	{ "DOUBLE", SF_FORMAT_DOUBLE }
+};
+
+static const std::map<std::string,int> Containers = {
+	{ "wav", SF_FORMAT_WAV },
+	{ "aif", SF_FORMAT_AIFF },
+	{ "aiff", SF_FORMAT_AIFF },
+	{ "au", SF_FORMAT_AU },
+	{ "caf", SF_FORMAT_CAF },
+	{ "flac", SF_FORMAT_FLAC },
+	{ "w64", SF_FORMAT_W64 }
+};
+
+static std::string subtypeName(const int format) {
+	for(auto &it : Subtypes) {
+		if(it.second==(format & SF_FORMAT_SUBMASK)) return it.first;
+	}
+	return "";
+}
+
+static int outputFormat(const FileJob &job,const SF_INFO &in) {
+	auto major=in.format & SF_FORMAT_TYPEMASK;
+	auto dot=job.outFile.find_last_of('.');
+	if(dot!=std::string::npos) {
+		auto extension=job.outFile.substr(dot+1);
+		std::transform(extension.begin(),extension.end(),extension.begin(),::tolower);
+		auto it=Containers.find(extension);
+		if(it!=Containers.end()) major=it->second;
+	}
+	auto minor=in.format & SF_FORMAT_SUBMASK;
+	if(!job.format.empty()) {
+		auto it=Subtypes.find(job.format);
+		if(it==Subtypes.end()) throw std::runtime_error("Unknown output format " + job.format);
+		minor=it->second;
+	}
+	return major | minor;
+}
+
+FileResult stretchFile(const FileJob &job,const Stretch::Options options,const unsigned blockSize) {
+	FileResult result;
+	SF_INFO sfinfo;
+	memset(&sfinfo, 0, sizeof(SF_INFO));
+
+	auto sndfile = sf_open(job.inFile.c_str(), SFM_READ, &sfinfo);
+	if (!sndfile) {
+		result.message = "Failed to open input file: " + std::string(sf_strerror(sndfile));
+		return result;
+	}
+	if (sfinfo.frames == 0 || sfinfo.samplerate == 0) {
+		result.message = "File lacks frame count or sample rate in header";
+		sf_close(sndfile);
+		return result;
+	}
+	if (!sfinfo.seekable) {
+		result.message = "Input file must be seekable, as it is read once to study and once to process";
+		sf_close(sndfile);
+		return result;
+	}
+
+	result.framesIn = sfinfo.frames;
+	result.rate = sfinfo.samplerate;
+	result.channels = sfinfo.channels;
+	result.seconds = double(sfinfo.frames) / double(sfinfo.samplerate);
+	result.ratio = (job.duration > 0.0) ? job.duration / result.seconds : job.ratio;
+
+	SF_INFO sfinfoOut;
+	memset(&sfinfoOut, 0, sizeof(SF_INFO));
+	sfinfoOut.channels = sfinfo.channels;
+	sfinfoOut.samplerate = sfinfo.samplerate;
+	try {
+		sfinfoOut.format = outputFormat(job,sfinfo);
+	}
+	catch(std::exception &e) {
+		result.message = e.what();
+		sf_close(sndfile);
+		return result;
+	}
+	if (!sf_format_check(&sfinfoOut)) {
+		result.message = "Output format is not valid for the output file type";
+		sf_close(sndfile);
+		return result;
+	}
+	result.format = subtypeName(sfinfoOut.format);
+
+	auto sndfileOut = sf_open(job.outFile.c_str(), SFM_WRITE, &sfinfoOut) ;
+	if (!sndfileOut) {
+		result.message = "Failed to open output file for writing: " + std::string(sf_strerror(sndfileOut));
+		sf_close(sndfile);
+		return result;
+	}
+
+	bool failed=false;
+	auto write = [sndfileOut,&failed](const float *data,const unsigned long frames) {
+		if(sf_writef_float(sndfileOut,data,frames)!=(sf_count_t)frames) failed=true;
+	};
+	try {
+		Stretch st(sfinfo,result.ratio,options,job.pitch);
+		st.setBlockSize(blockSize);
+		SndfileSource source(sndfile);
+		result.framesOut=st(source,write);
+		result.ok=!failed;
+		if(failed) result.message = "Failed writing to output file: " + std::string(sf_strerror(sndfileOut));
+	}
+	catch(std::exception &e) {
+		result.message=e.what();
+	}
+	sf_close(sndfile);
+	sf_close(sndfileOut);
+	return result;
+}
@@ -0,0 +1,56 @@
+/*
+ * files.hpp
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef SRC_FILES_HPP_
+#define SRC_FILES_HPP_
+
+#include <string>
+#include <sndfile.h>
+#include "stretch.hpp"
+
+// Reads a sound file a block at a time, seeking back to the start for each
+// pass, so no more than a block of input is ever held in memory.
+
+class SndfileSource : public StretchSource {
+private:
+	SNDFILE *file;
+public:
+	SndfileSource(SNDFILE *file_) : StretchSource(), file(file_) {};
+	virtual ~SndfileSource() = default;
+
+	virtual unsigned long read(float *data,const unsigned long frames);
+	virtual void rewind();
+};
+
+// One file to stretch: to a target duration in seconds if one is given,
+// otherwise by a ratio.  The output has the container implied by its
+// extension, or else that of the input, and the sample format named by
+// format, or else that of the input.
+
+struct FileJob {
+	std::string inFile;
+	std::string outFile;
+	double duration;
+	double ratio;
+	std::string format = "";
+	double pitch = 1.0;
+};
+
+struct FileResult {
+	bool ok=false;
+	std::string message;
+	double seconds=0;
+	double ratio=0;
+	int rate=0;
+	int channels=0;
+	std::string format;
+	unsigned long framesIn=0;
+	unsigned long framesOut=0;
+};
+
+FileResult stretchFile(const FileJob &job,const Stretch::Options options,const unsigned blockSize);
+
+#endif /* SRC_FILES_HPP_ */
@@ -0,0 +1,29 @@
+/*
+ * gil.hpp
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef SRC_GIL_HPP_
+#define SRC_GIL_HPP_
+
+#include <Python.h>
+
+// Releases the GIL for the lifetime of the object, so native work can run
+// alongside other Python threads.  No Python API may be used while it is held.
+
+class GILRelease {
+private:
+	PyThreadState *state;
+
+public:
+	GILRelease() : state(PyEval_SaveThread()) {};
+	virtual ~GILRelease() { PyEval_RestoreThread(state); }
+
+	GILRelease(const GILRelease &) = delete;
+	GILRelease & operator=(const GILRelease &) = delete;
+};
+
+
+
+#endif /* SRC_GIL_HPP_ */
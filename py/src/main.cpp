@@ -31,13 +31,24 @@
 #include <cstring>
 #include <string>
 #include <algorithm>
+#include <map>
+#include <cerrno>
+#include <stdexcept>
 #include <getopt.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <fstream>
+#include <sstream>
+#include <chrono>
+#include <filesystem>
 
 #include "stretch.hpp"
-#include "Debug.hpp"
+#include "files.hpp"
+#include "workers.hpp"
+#include "pcm.hpp"
 
 
 using namespace RubberBand;
@@ -45,11 +56,258 @@ using namespace RubberBand;
 
 
 static const int ibs=1024;
+
+// A manifest has one job per line: input file, output file and optionally a
+// duration in seconds or a ratio prefixed with 'x', e.g. "a.wav b.wav x1.25".
+// Otherwise the duration or ratio from the command line applies.  Blank lines
+// and lines starting with '#' are ignored.
+
+static std::vector<FileJob> readManifest(const std::string &path,const FileJob &defaults) {
+	std::ifstream manifest(path);
+	if(!manifest) throw std::runtime_error("Cannot open manifest " + path);
+	std::vector<FileJob> jobs;
+	std::string line;
+	unsigned number=0;
+	while(std::getline(manifest,line)) {
+		number++;
+		std::istringstream fields(line);
+		FileJob job=defaults;
+		if(!(fields >> job.inFile) || job.inFile[0]=='#') continue;
+		if(!(fields >> job.outFile)) throw std::runtime_error("Manifest line " + std::to_string(number) + " has no output file");
+		std::string amount;
+		if(fields >> amount) {
+			if(amount[0]=='x') {
+				job.ratio=std::stod(amount.substr(1));
+				job.duration=-1;
+			}
+			else {
+				job.duration=std::stod(amount);
+			}
+		}
+		jobs.push_back(job);
+	}
+	return jobs;
+}
+
+static std::vector<FileJob> readDirectory(const std::string &inDir,const std::string &outDir,const FileJob &defaults) {
+	std::vector<FileJob> jobs;
+	std::filesystem::create_directories(outDir);
+	for(auto &entry : std::filesystem::directory_iterator(inDir)) {
+		if(!entry.is_regular_file()) continue;
+		FileJob job=defaults;
+		job.inFile=entry.path().string();
+		job.outFile=(std::filesystem::path(outDir) / entry.path().filename()).string();
+		jobs.push_back(job);
+	}
+	std::sort(jobs.begin(),jobs.end(),[](const FileJob &a,const FileJob &b) { return a.inFile<b.inFile; });
+	return jobs;
+}
+
+static int runBatch(const std::vector<FileJob> &jobs,const Stretch::Options options,const unsigned blockSize,const unsigned nWorkers) {
+	std::vector<FileResult> results(jobs.size());
+	auto start=std::chrono::steady_clock::now();
+	workers::parallel(jobs.size(),nWorkers,[&jobs,&results,options,blockSize](const unsigned long i) {
+		results[i]=stretchFile(jobs[i],options,blockSize);
+	});
+	std::chrono::duration<double> elapsed=std::chrono::steady_clock::now()-start;
+
+	double seconds=0;
+	unsigned failures=0;
+	for(unsigned long i=0;i<jobs.size();i++) {
+		auto &r=results[i];
+		if(r.ok) {
+			seconds+=r.seconds;
+			std::cout << jobs[i].inFile << " -> " << jobs[i].outFile << " : " << r.framesIn << " -> " << r.framesOut << " frames" << std::endl;
+		}
+		else {
+			failures++;
+			std::cerr << "ERROR: " << jobs[i].inFile << " : " << r.message << std::endl;
+		}
+	}
+	std::cout << jobs.size()-failures << " of " << jobs.size() << " files, " << seconds << " s of audio in "
+			<< elapsed.count() << " s on " << nWorkers << " workers : "
+			<< ((elapsed.count()>0) ? seconds/elapsed.count() : 0.0) << " audio seconds per second" << std::endl;
+	return (failures>0) ? 1 : 0;
+}
+
+// Headerless PCM, given on the command line as FORMAT,RATE,CHANNELS, with
+// FORMAT one of the names rubberband uses for sample formats.
+
+struct RawFormat {
+	size_t size;
+	void (*decode)(const char *,const size_t,float *);
+	void (*encode)(const float *,const size_t,char *);
+	int rate;
+	unsigned channels;
+};
+
+template<typename T>
+RawFormat rawFormat() {
+	RawFormat format;
+	format.size=sizeof(T);
+	format.decode=[](const char *in,const size_t n,float *out) {
+		auto samples=reinterpret_cast<const T *>(in);
+		if constexpr (std::is_floating_point<T>::value) std::copy(samples,samples+n,out);
+		else pcm::decode(samples,n,out);
+	};
+	format.encode=[](const float *in,const size_t n,char *out) {
+		auto samples=reinterpret_cast<T *>(out);
+		if constexpr (std::is_floating_point<T>::value) std::copy(in,in+n,samples);
+		else pcm::encode(in,n,samples);
+	};
+	return format;
+}
+
+static RawFormat parseRaw(const std::string &spec) {
+	static const std::map<std::string,RawFormat (*)()> formats = {
+		{ "uint8", rawFormat<uint8_t> },
+		{ "int8", rawFormat<int8_t> },
+		{ "int16", rawFormat<int16_t> },
+		{ "int24", rawFormat<pcm::int24_t> },
+		{ "int32", rawFormat<int32_t> },
+		{ "int64", rawFormat<int64_t> },
+		{ "float32", rawFormat<float> },
+		{ "float64", rawFormat<double> }
+	};
+	std::istringstream fields(spec);
+	std::string name, rate, channels;
+	if(!std::getline(fields,name,',') || !std::getline(fields,rate,',') || !std::getline(fields,channels)) {
+		throw std::runtime_error("Raw format must be FORMAT,RATE,CHANNELS");
+	}
+	auto it=formats.find(name);
+	if(it==formats.end()) throw std::runtime_error("Unknown raw sample format " + name);
+	auto format=it->second();
+	format.rate=std::stoi(rate);
+	format.channels=std::stoi(channels);
+	if(format.rate<=0 || format.channels<1) throw std::runtime_error("Raw rate and channel count must be positive");
+	return format;
+}
+
+// A memory-mapped file.  The page cache is the only buffer: input is decoded
+// straight from the mapping a block at a time, and output encoded straight
+// into it.  The output mapping grows if the estimate of its size falls short.
+
+// Closes the descriptor however the owner is torn down, including when its
+// constructor throws after the file was opened.
+
+class Descriptor {
+public:
+	int fd;
+	Descriptor(const std::string &path,const int flags,const mode_t mode=0) : fd(open(path.c_str(),flags,mode)) {
+		if(fd<0) throw std::runtime_error("Cannot open " + path + ": " + strerror(errno));
+	}
+	~Descriptor() { close(fd); }
+	Descriptor(const Descriptor &) = delete;
+	Descriptor & operator=(const Descriptor &) = delete;
+};
+
+class MappedFile {
+private:
+	Descriptor file;
+	char *base=nullptr;
+	size_t length=0;
+	bool writable;
+
+	void unmap() {
+		if(base!=nullptr) munmap(base,length);
+		base=nullptr;
+	}
+	void map() {
+		if(length==0) return;
+		auto mapped=mmap(nullptr,length,writable ? PROT_READ|PROT_WRITE : PROT_READ,MAP_SHARED,file.fd,0);
+		if(mapped==MAP_FAILED) throw std::runtime_error("Cannot map file: " + std::string(strerror(errno)));
+		base=static_cast<char *>(mapped);
+		madvise(base,length,MADV_SEQUENTIAL);
+	}
+
+public:
+	MappedFile(const std::string &path) : file(path,O_RDONLY), writable(false) {
+		struct stat info;
+		if(fstat(file.fd,&info)<0) throw std::runtime_error("Cannot stat " + path + ": " + strerror(errno));
+		length=info.st_size;
+		map();
+	}
+	MappedFile(const std::string &path,const size_t size) : file(path,O_RDWR|O_CREAT|O_TRUNC,0644), writable(true) {
+		resize(size);
+	}
+	virtual ~MappedFile() {
+		unmap();
+	}
+	MappedFile(const MappedFile &) = delete;
+	MappedFile & operator=(const MappedFile &) = delete;
+
+	void resize(const size_t size) {
+		unmap();
+		if(ftruncate(file.fd,size)<0) throw std::runtime_error("Cannot size output: " + std::string(strerror(errno)));
+		length=size;
+		map();
+	}
+	char *data() const { return base; }
+	size_t size() const { return length; }
+};
+
+class MappedSource : public StretchSource {
+private:
+	const MappedFile &file;
+	RawFormat format;
+	unsigned long offset=0;
+public:
+	MappedSource(const MappedFile &file_,const RawFormat &format_) : StretchSource(), file(file_), format(format_) {};
+	virtual ~MappedSource() = default;
+
+	unsigned long frames() const { return file.size()/(format.size*format.channels); }
+	virtual unsigned long read(float *data,const unsigned long n) {
+		auto count=std::min<unsigned long>(n,frames()-offset);
+		format.decode(file.data()+offset*format.size*format.channels,count*format.channels,data);
+		offset+=count;
+		return count;
+	}
+	virtual void rewind() { offset=0; }
+};
+
+static int stretchRaw(const FileJob &job,const RawFormat &format,const Stretch::Options options,const unsigned blockSize) {
+	try {
+		MappedFile in(job.inFile);
+		MappedSource source(in,format);
+		auto framesIn=source.frames();
+		auto seconds=double(framesIn)/double(format.rate);
+		auto ratio = (job.duration > 0.0) ? job.duration / seconds : job.ratio;
+
+		auto frameSize=format.size*format.channels;
+		unsigned long estimate=(unsigned long)std::ceil(framesIn*ratio)+ibs;
+		MappedFile out(job.outFile,estimate*frameSize);
+		unsigned long framesOut=0;
+		auto write = [&out,&format,&framesOut,frameSize](const float *data,const unsigned long frames) {
+			auto needed=(framesOut+frames)*frameSize;
+			if(needed>out.size()) out.resize(std::max<size_t>(needed,2*out.size()));
+			format.encode(data,frames*format.channels,out.data()+framesOut*frameSize);
+			framesOut+=frames;
+		};
+
+		Stretch st(framesIn,format.channels,format.rate,ratio,options);
+		st.setBlockSize(blockSize);
+		st(source,write);
+		out.resize(framesOut*frameSize);
+		std::cout << "wrote " << framesOut << " frames" << std::endl;
+		return 0;
+	}
+	catch(std::exception &e) {
+		std::cerr << "ERROR: " << job.inFile << " : " << e.what() << std::endl;
+		return 1;
+	}
+}
+
 static struct option opts[] = {
 		{ "crispness", required_argument, 0, 'c' },
 		{ "formants",  no_argument,       0, 'f' },
 		{ "precise",   no_argument,       0, 'p' },
 		{ "duration",  required_argument, 0, 'd' },
+		{ "ratio",     required_argument, 0, 'r' },
+		{ "manifest",  required_argument, 0, 'm' },
+		{ "batch",     no_argument,       0, 'b' },
+		{ "jobs",      required_argument, 0, 'j' },
+		{ "raw",       required_argument, 0, 'R' },
+		{ "block-size", required_argument, 0, 'B' },
 		{ 0,0,0,0 }
 };
 
@@ -59,11 +317,17 @@ int main(int argc, char **argv)
 	bool formants = false;
 	bool precise = false;
 	double duration = -1;
+	double ratio = -1;
+	std::string manifest;
+	bool batch = false;
+	unsigned nWorkers = workers::defaultCount();
+	std::string raw;
+	unsigned blockSize = Stretch::BlockSize;
 
 	opterr = 0;  // quiet option scanning
 	int optionIndex = 0;
 	while(true) {
-		auto c=getopt_long(argc,argv,"c::fpd:",opts,&optionIndex);
+		auto c=getopt_long(argc,argv,"c::fpd:r:m:bj:R:B:",opts,&optionIndex);
 		if(c == -1) break;
 
 		switch(c) {
@@ -76,9 +340,27 @@ int main(int argc, char **argv)
 		case 'd':
 			duration=std::stod(optarg);
 			break;
+		case 'r':
+			ratio=std::stod(optarg);
+			break;
 		case 'c':
 			crispness=std::stoi(optarg);
 			break;
+		case 'm':
+			manifest=optarg;
+			break;
+		case 'b':
+			batch=true;
+			break;
+		case 'j':
+			nWorkers=std::max(1,std::stoi(optarg));
+			break;
+		case 'R':
+			raw=optarg;
+			break;
+		case 'B':
+			blockSize = (std::string(optarg)=="auto") ? Stretch::AutoBlockSize : std::max(1,std::stoi(optarg));
+			break;
 		}
 	}
 
@@ -86,96 +368,68 @@ int main(int argc, char **argv)
 		std::cerr << "Error: crispness must be between 0 and 6" << std::endl;
 		return 2;
 	}
-	if(duration<=0.0) {
-		std::cerr << "Error: duration must be non-negative float" << std::endl;
-		return 2;
+	auto options=Stretch::makeOptions(crispness,formants,precise);
+	FileJob defaults { "", "", duration, ratio };
+
+	if(!manifest.empty() || batch) {
+		try {
+			std::vector<FileJob> jobs;
+			if(!manifest.empty()) {
+				jobs=readManifest(manifest,defaults);
+			}
+			else {
+				if(argc-optind<2) {
+					std::cerr << "Error: batch mode needs input and output directories" << std::endl;
+					return 2;
+				}
+				jobs=readDirectory(argv[optind],argv[optind+1],defaults);
+			}
+			for(auto &job : jobs) {
+				if(job.duration<=0.0 && job.ratio<=0.0) {
+					std::cerr << "Error: no duration or ratio for " << job.inFile << std::endl;
+					return 2;
+				}
+			}
+			return runBatch(jobs,options,blockSize,nWorkers);
+		}
+		catch(std::exception &e) {
+			std::cerr << "Error: " << e.what() << std::endl;
+			return 2;
+		}
 	}
 
-	auto o=optind;
-    const char *inFile = strdup(argv[o]);
-    const char *outFile= strdup(argv[o+1]);
-
-
-    std::cout << "processing " << inFile << " -> " << outFile << " with duration " << duration << std::endl;
-    std::cout << "crispness = " << crispness << std::endl;
-    std::cout << "formants  = " << formants << std::endl;
-    std::cout << "precise   = " << precise << std::endl;
-
-    SF_INFO sfinfo;
-    memset(&sfinfo, 0, sizeof(SF_INFO));
-
-    auto sndfile = sf_open(inFile, SFM_READ, &sfinfo);
-    if (!sndfile) {
-    	std::cerr << "ERROR: Failed to open input file \"" << inFile << "\": " << sf_strerror(sndfile) << std::endl;
-    	return 1;
-    }
-    if (sfinfo.frames == 0 || sfinfo.samplerate == 0) {
-        std::cerr << "ERROR: File lacks frame count or sample rate in header, cannot use --duration" << std::endl;
-        return 1;
-    }
-    if (sfinfo.channels > 1) {
-    	std::cerr << "ERROR: This library only works with mono files" << std::endl;
-    	return 1;
-    }
-
-    auto induration = double(sfinfo.frames) / double(sfinfo.samplerate);
-    auto ratio = (induration != 0.0) ? duration / induration : 0.0;
-
-    std::vector<float> in;
-    auto buffer = new float[ibs];
-    int frame = 0;
-    while (frame < sfinfo.frames) {
-        auto count = sf_readf_float(sndfile, buffer, ibs);
-        if (count<=0) break;
-        in.insert(in.end(),buffer,buffer+count);
-        frame+=count;
-    }
-    sf_close(sndfile);
-    delete[] buffer;
-
-    std::cout << "In:" << std::endl;
-    for(auto i=0;i<100;i++) {
-    	std::cout << in[i] << " ";
-    	if(5== i%6) std::cout << std::endl;
-    }
-
-    //debug::set(debug::Level::Basic);
-
-    auto options=Stretch::makeOptions(crispness,formants,precise);
-    Stretch st(sfinfo,ratio,options);
-    auto out = st(in);
-
-    std::cout << std::endl << "Out:" << std::endl;
-    for(auto i=0;i<100;i++) {
-        	std::cout << out[i] << " ";
-        	if(5== i%6) std::cout << std::endl;
-        }
-
-    SF_INFO sfinfoOut;
-    sfinfoOut.channels = sfinfo.channels;
-    sfinfoOut.format = sfinfo.format;
-    sfinfoOut.frames = out.size();
-    sfinfoOut.samplerate = sfinfo.samplerate;
-    sfinfoOut.sections = sfinfo.sections;
-    sfinfoOut.seekable = sfinfo.seekable;
-    auto sndfileOut = sf_open(outFile, SFM_WRITE, &sfinfoOut) ;
-    if (!sndfileOut) {
-    	std::cerr << "ERROR: Failed to open output file \"" << outFile << "\" for writing: "
-    			<< sf_strerror(sndfileOut) << std::endl;
-        return 1;
-    }
-
-    int offset=0;
-    while(offset<out.size()) {
-    	int set=std::min((int)out.size()-offset,ibs);
-    	auto wrote=sf_writef_float(sndfileOut, out.data()+offset, set);
-    	if(wrote<=0) break;
-    	offset+=wrote;
-    }
-    sf_close(sndfileOut);
-
-    return 0;
-}
-
+	if(duration<=0.0 && ratio<=0.0) {
+		std::cerr << "Error: duration or ratio must be a positive float" << std::endl;
+		return 2;
+	}
+	if(argc-optind<2) {
+		std::cerr << "Error: need input and output files" << std::endl;
+		return 2;
+	}
 
+	FileJob job { argv[optind], argv[optind+1], duration, ratio };
+	std::cout << "processing " << job.inFile << " -> " << job.outFile << " with ";
+	if(duration>0.0) std::cout << "duration " << duration << std::endl;
+	else std::cout << "ratio " << ratio << std::endl;
+	std::cout << "crispness = " << crispness << std::endl;
+	std::cout << "formants  = " << formants << std::endl;
+	std::cout << "precise   = " << precise << std::endl;
+
+	if(!raw.empty()) {
+		try {
+			return stretchRaw(job,parseRaw(raw),options,blockSize);
+		}
+		catch(std::exception &e) {
+			std::cerr << "Error: " << e.what() << std::endl;
+			return 2;
+		}
+	}
 
+	auto result=stretchFile(job,options,blockSize);
+	if(!result.ok) {
+		std::cerr << "ERROR: " << job.inFile << " : " << result.message << std::endl;
+		return 1;
+	}
+	std::cout << "wrote " << result.framesOut << " frames" << std::endl;
+	return 0;
+}
@@ -9,83 +9,263 @@
 #include "numpy.hpp"
 #include <stdexcept>
 #include <map>
-#include <iostream>
 #include <cmath>
+#include <cstring>
+#include <cstdint>
 #include "stretch.hpp"
+#include "gil.hpp"
+#include "stats.hpp"
+#include "pcm.hpp"
 
 
 #define PY_ARRAY_UNIQUE_SYMBOL rubberband_ARRAY_API
 #define NO_IMPORT_ARRAY
 #include <arrayobject.h>
 
-double clip(const range_t &range,const double x) { return std::max(range.first,std::min(range.second,x)); }
-
-
-
 Content discriminate(PyObject *o) {
 	if(PyArray_Check(o)) {
 		PyArrayObject *array=(PyArrayObject *)o;
-		if(array!=nullptr && PyArray_NDIM(array)==1) return Content::Array;
+		if(array!=nullptr && (PyArray_NDIM(array)==1 || PyArray_NDIM(array)==2)) return Content::Array;
 	}
 	else if(PyList_Check(o)) return Content::List;
-	else if(PyBytes_Check(o)) return Content::Buffer;
-	throw std::runtime_error("Input data must be of type np.array, list or bytes");
+	else if(PyObject_CheckBuffer(o)) return Content::Buffer;
+	throw std::runtime_error("Input data must be of type np.array, list or support the buffer protocol");
 }
 
-std::map<Content,std::string> names {
-	{ Content::Array , "numpy" },
-	{ Content::List, "list" },
-	{ Content::Buffer, "bytes" }
-};
-
 std::map<int,std::string> PyTransformer::formatNames {
 		{ NPY_FLOAT , "float32" },
 		{ NPY_UINT8 , "uint8" },
 		{ NPY_INT8 , "int8" },
 		{ NPY_INT16 , "int16" },
-		{ NPY_INT32 , "int32" }
+		{ NPY_INT32 , "int32" },
+		{ NPY_INT64 , "int64" },
+		{ NPY_DOUBLE , "float64" },
+		{ PyTransformer::PCM24 , "int24" }
 };
 
-bool PyTransformer::Debug = false;
-std::map<int,float> PyTransformer::casts {
-		{ NPY_FLOAT , 1.0 },
-		{ NPY_UINT8 , 255.0 },
-		{ NPY_INT8 , 128.0 },
-		{ NPY_INT16 , 32768.0 },
-		{ NPY_INT32 , 2147483648.0 }
-};
-std::map<int,range_t> PyTransformer::ranges {
-		{ NPY_UINT8 , std::make_pair(0.0,255.0) },
-		{ NPY_INT8 ,  std::make_pair(-128.0,127.0) },
-		{ NPY_INT16 , std::make_pair(-32768.0,32767.0) },
-		{ NPY_INT32 , std::make_pair(-2147483648.0,2147483647.0) }
-};
+// Packed 24-bit PCM has no numpy type number, so takes one beyond numpy's range.
+// numpy arrays of it use the three-byte void dtype "V3".
+
+const int PyTransformer::PCM24 = NPY_USERDEF + 1024;
+
+
+
+// Calls f with a value of the C type matching a numpy format, so each
+// conversion is specialised at compile time and selected once per call
+
+template<typename F>
+void withFormat(const int format,F &&f) {
+	switch(format) {
+		case NPY_FLOAT:
+			f(float());
+			break;
+		case NPY_DOUBLE:
+			f(double());
+			break;
+		case NPY_UINT8:
+			f(uint8_t());
+			break;
+		case NPY_INT8:
+			f(int8_t());
+			break;
+		case NPY_INT16:
+			f(int16_t());
+			break;
+		case NPY_INT32:
+			f(int32_t());
+			break;
+		case NPY_INT64:
+			f(int64_t());
+			break;
+		case PyTransformer::PCM24:
+			f(pcm::int24_t());
+			break;
+		default:
+			throw std::runtime_error("Unsupported sample format");
+	}
+}
+
+static size_t sampleSize(const int format) {
+	size_t size=0;
+	withFormat(format,[&size](auto tag) { size=sizeof(tag); });
+	return size;
+}
 
+static PyArray_Descr * descriptor(const int format) {
+	if(format!=PyTransformer::PCM24) return PyArray_DescrFromType(format);
+	PyArray_Descr *descr=nullptr;
+	PyObject *spec=PyUnicode_FromString("V3");
+	auto ok=PyArray_DescrConverter(spec,&descr);
+	Py_XDECREF(spec);
+	if(!ok) throw std::runtime_error("Cannot create 24-bit dtype");
+	return descr;
+}
 
+// The format of an array, from the kind and size of its dtype rather than its
+// type number, so aliases such as long / long long resolve to the same format
+
+static int arrayFormat(PyArray_Descr *dtype) {
+	auto size=dtype->elsize;
+	switch(dtype->kind) {
+		case 'f':
+			if(size==4) return NPY_FLOAT;
+			if(size==8) return NPY_DOUBLE;
+			break;
+		case 'u':
+			if(size==1) return NPY_UINT8;
+			break;
+		case 'i':
+			if(size==1) return NPY_INT8;
+			if(size==2) return NPY_INT16;
+			if(size==4) return NPY_INT32;
+			if(size==8) return NPY_INT64;
+			break;
+		case 'V':
+			if(size==3) return PyTransformer::PCM24;
+			break;
+	}
+	throw std::runtime_error("Unsupported array dtype");
+}
+
+static const size_t block = 1024;
+
+template<typename T>
+void gather(vect_t &out,const char *data,const Py_ssize_t n,const Py_ssize_t stride) {
+	out.resize(n);
+	bool contiguous = stride==sizeof(T) && reinterpret_cast<std::uintptr_t>(data) % alignof(T) == 0;
+	T raw[block];
+	for(Py_ssize_t i=0;i<n;i+=block) {
+		auto m=std::min<Py_ssize_t>(block,n-i);
+		auto src=reinterpret_cast<const T *>(data+i*stride);
+		if(!contiguous) {
+			for(Py_ssize_t j=0;j<m;j++) memcpy(raw+j,data+(i+j)*stride,sizeof(T));
+			src=raw;
+		}
+		if constexpr (std::is_floating_point<T>::value) std::copy(src,src+m,out.data()+i);
+		else pcm::decode(src,m,out.data()+i);
+	}
+}
+
+template<typename T>
+void scatter(const vect_t &in,char *data) {
+	auto dst=reinterpret_cast<T *>(data);
+	if constexpr (std::is_floating_point<T>::value) std::copy(in.begin(),in.end(),dst);
+	else pcm::encode(in.data(),in.size(),dst);
+}
+
+void PyTransformer::samplesToVector(const char *data,const Py_ssize_t n,const Py_ssize_t stride) {
+	withFormat(format,[this,data,n,stride](auto tag) {
+		gather<decltype(tag)>(in,data,n,stride);
+	});
+}
+
+void PyTransformer::vectorToSamples(char *data) {
+	withFormat(format,[this,data](auto tag) {
+		scatter<decltype(tag)>(out,data);
+	});
+}
 
 void PyTransformer::numpyToVector(PyObject *obj) {
-	PyObject *inter=PyArray_Cast((PyArrayObject *)obj,NPY_FLOAT);
-	PyObject *list=PyArray_ToList((PyArrayObject *)inter);
-	listToVector(list);
+	auto array=(PyArrayObject *)obj;
+	auto nDims=PyArray_NDIM(array);
+	if(nDims==2) channels=PyArray_DIM(array,1);
+	if(channels==0) throw std::runtime_error("Array has no channels");
+
+	if(PyArray_ISNOTSWAPPED(array) && (nDims==1 || PyArray_IS_C_CONTIGUOUS(array))) {
+		samplesToVector(PyArray_BYTES(array),PyArray_SIZE(array),PyArray_STRIDE(array,nDims-1));
+	}
+	else {
+		auto dtype=descriptor(format);
+		auto native=(PyArrayObject *)PyArray_FromAny(obj,dtype,nDims,nDims,NPY_ARRAY_CARRAY,NULL);
+		if(native==nullptr) throw std::runtime_error("Cannot convert array to native byte order");
+		samplesToVector(PyArray_BYTES(native),PyArray_SIZE(native),PyArray_ITEMSIZE(native));
+		Py_DECREF(native);
+	}
+}
+
+static const char *SamplesCapsule = "rubberband.samples";
+
+static void releaseSamples(PyObject *capsule) {
+	delete (vect_t *)PyCapsule_GetPointer(capsule,SamplesCapsule);
 }
 
+// float32 output is handed over without copying: the array takes ownership
+// of the sample vector through a capsule as its base object
+
 PyObject *PyTransformer::vectorToNumpy() {
-	PyObject *list=vectorToList();
-	PyObject *inter=PyArray_FROM_OT(list,NPY_FLOAT);
-	return PyArray_Cast((PyArrayObject *)inter,format);
+	npy_intp dims[] = { (npy_intp)(out.size()/channels), (npy_intp)channels };
+	int nDims = channels>1 ? 2 : 1;
+	if(format==NPY_FLOAT) {
+		auto owner=new vect_t(std::move(out));
+		PyObject *capsule=PyCapsule_New(owner,SamplesCapsule,releaseSamples);
+		if(capsule==nullptr) {
+			delete owner;
+			throw std::runtime_error("Cannot allocate array");
+		}
+		PyObject *array=PyArray_SimpleNewFromData(nDims,dims,NPY_FLOAT,owner->data());
+		if(array==nullptr) {
+			Py_DECREF(capsule);
+			throw std::runtime_error("Cannot allocate array");
+		}
+		if(PyArray_SetBaseObject((PyArrayObject *)array,capsule)<0) {
+			Py_DECREF(array);
+			throw std::runtime_error("Cannot allocate array");
+		}
+		return array;
+	}
+	PyObject *array=PyArray_NewFromDescr(&PyArray_Type,descriptor(format),nDims,dims,NULL,NULL,0,NULL);
+	if(array==nullptr) throw std::runtime_error("Cannot allocate array");
+	vectorToSamples(PyArray_BYTES((PyArrayObject *)array));
+	return array;
 }
 
 void PyTransformer::bufferToVector(PyObject *buffer) {
-	auto dtype=PyArray_DescrFromType(format);
-	auto n=PyBytes_Size(buffer);
-	auto ptr=PyBytes_AsString(buffer);
-	PyObject *inter = PyArray_FromString(ptr,n,dtype,-1,NULL);
-	return numpyToVector(inter);
+	Py_buffer b;
+	if(PyObject_GetBuffer(buffer,&b,PyBUF_STRIDED_RO)<0) {
+		PyErr_Clear();
+		throw std::runtime_error("Cannot access buffer");
+	}
+	auto itemsize=sampleSize(format);
+	try {
+		if(b.ndim==1 && (size_t)b.itemsize==itemsize) {
+			samplesToVector((const char *)b.buf,b.shape[0],b.strides[0]);
+		}
+		else if(PyBuffer_IsContiguous(&b,'C')) {
+			if(b.len%itemsize) throw std::runtime_error("Buffer size is not a multiple of the sample size");
+			samplesToVector((const char *)b.buf,b.len/itemsize,itemsize);
+		}
+		else {
+			throw std::runtime_error("Buffer must be contiguous or one-dimensional");
+		}
+	}
+	catch(...) {
+		PyBuffer_Release(&b);
+		throw;
+	}
+	PyBuffer_Release(&b);
 }
 
 PyObject *PyTransformer::vectorToBuffer() {
-	PyArrayObject * inter = (PyArrayObject *)vectorToNumpy();
-	return PyArray_ToString(inter,NPY_CORDER);
+	auto itemsize=sampleSize(format);
+	auto size=out.size()*itemsize;
+	if(mutableBuffer) {
+		PyObject *buffer=PyByteArray_FromStringAndSize(NULL,size);
+		if(buffer==nullptr) throw std::runtime_error("Cannot allocate bytearray");
+		vectorToSamples(PyByteArray_AS_STRING(buffer));
+		return buffer;
+	}
+	PyObject *buffer=PyBytes_FromStringAndSize(NULL,size);
+	if(buffer==nullptr) throw std::runtime_error("Cannot allocate bytes");
+	vectorToSamples(PyBytes_AS_STRING(buffer));
+	return buffer;
+}
+
+PyObject *PyTransformer::vectorToView() {
+	PyObject *array=vectorToNumpy();
+	PyObject *memory=PyMemoryView_FromObject(array);
+	Py_DECREF(array);
+	if(memory==nullptr) throw std::runtime_error("Cannot create memoryview");
+	return memory;
 }
 
 void PyTransformer::listToVector(PyObject *obj) {
@@ -94,34 +274,44 @@ void PyTransformer::listToVector(PyObject *obj) {
 	if(n<0) throw std::runtime_error("Object is not a list");
 
 	in.assign(n,0.0);
-	for(auto i=0;i<n;i++) {
-		auto item = PyList_GetItem(obj,i);
-		if(item==NULL) throw std::runtime_error("Cannot read list entries");
-		if(!PyFloat_Check(item)) throw std::runtime_error("Non-float list entries");
-		in[i]=PyFloat_AS_DOUBLE(item);
-	}
+	withFormat(format,[this,obj,n](auto tag) {
+		using T = decltype(tag);
+		for(auto i=0;i<n;i++) {
+			auto item = PyList_GetItem(obj,i);
+			if(item==NULL) throw std::runtime_error("Cannot read list entries");
+			if(!PyFloat_Check(item)) throw std::runtime_error("Non-float list entries");
+			auto value = PyFloat_AS_DOUBLE(item);
+			if constexpr (std::is_floating_point<T>::value) {
+				in[i]=value;
+			}
+			else {
+				using tr = pcm::Traits<T>;
+				in[i]=(value-tr::offset)/tr::scale;
+			}
+		}
+	});
 }
 
 PyObject *PyTransformer::vectorToList() {
 	unsigned long n = out.size();
 	auto obj=PyList_New(n);
 	if(obj==nullptr) throw std::runtime_error("Cannot allocate list");
-	if(format==NPY_FLOAT) {
-		for(unsigned long i=0;i<n;i++) {
-			auto val = PyFloat_FromDouble(out[i]);
-			PyList_SetItem(obj,i,val);
-		}
-	}
-	else {
+	withFormat(format,[this,obj,n](auto tag) {
+		using T = decltype(tag);
 		for(unsigned long i=0;i<n;i++) {
-			auto val =PyLong_FromLong((long)out[i]);
-			PyList_SetItem(obj,i,val);
+			if constexpr (std::is_floating_point<T>::value) {
+				PyList_SetItem(obj,i,PyFloat_FromDouble(out[i]));
+			}
+			else {
+				PyList_SetItem(obj,i,PyLong_FromLongLong(pcm::quantise<T>(out[i])));
+			}
 		}
-	}
+	});
 	return obj;
 }
 
 void PyTransformer::unpack(PyObject *stream) {
+	stats::Timer timer(stats::Stage::Unpack);
 	switch(mode) {
 		case Content::List:
 			listToVector(stream);
@@ -133,60 +323,12 @@ void PyTransformer::unpack(PyObject *stream) {
 			bufferToVector(stream);
 			break;
 		}
-	if(format!=NPY_FLOAT) {
-		auto scale = 1.0/PyTransformer::casts.at(format);
-		auto range = PyTransformer::ranges.at(format);
-
-		if(Debug) {
-			std::cout << "Scaler: " << scale << std::endl;
-			std::cout << "Range : " << range.first << " - " << range.second << std::endl;
-			std::cout << "Unscaled In:" << std::endl;
-			for(auto i=0;i<25;i++) {
-				std::cout << in[i] << " ";
-				if(5== i%6) std::cout << std::endl;
-			}
-			std::cout << std::endl;
-		}
-
-		std::transform(in.begin(),in.end(),in.begin(),[scale,range](double x){ return x*clip(range,scale); });
-		if(Debug) {
-			std::cout << "Scaled In:" << std::endl;
-			for(auto i=0;i<25;i++) {
-				std::cout << in[i] << " ";
-				if(5== i%6) std::cout << std::endl;
-			}
-			std::cout << std::endl;
-		}
-	}
+	stats::add(stats::Counter::AllocatedBytes,in.size()*sizeof(float));
 }
 
 PyObject *PyTransformer::pack() {
-	if(format!=NPY_FLOAT) {
-		auto scale = PyTransformer::casts.at(format);
-		auto range = PyTransformer::ranges.at(format);
-
-		if(Debug) {
-			std::cout << "Unscaled out:" << std::endl;
-			for(auto i=0;i<25;i++) {
-				std::cout << out[i] << " ";
-				if(5== i%6) std::cout << std::endl;
-			}
-			std::cout << std::endl;
-		}
-
-		std::transform(out.begin(),out.end(),out.begin(),[scale,range](double x){ return clip(range,round(x*scale)); });
-
-		if(Debug) {
-				std::cout << "Scaler: " << scale << std::endl;
-				std::cout << "Range : " << range.first << " - " << range.second << std::endl;
-				std::cout << "Scaled and truncated out:" << std::endl;
-				for(auto i=0;i<25;i++) {
-					std::cout << out[i] << " ";
-					if(5== i%6) std::cout << std::endl;
-				}
-				std::cout << std::endl;
-			}
-	}
+	stats::Timer timer(stats::Stage::Pack);
+	if(view) return vectorToView();
 	switch(mode) {
 		case Content::List:
 			return vectorToList();
@@ -201,59 +343,52 @@ PyObject *PyTransformer::pack() {
 
 
 PyTransformer::PyTransformer(PyObject *stream,const int format_, const long sampleRate_,
-		const double ratio_, const int crispness_, const int precise_, const int formants_) :
-		sampleRate(sampleRate_), ratio(ratio_), crispness(crispness_), precise(precise_!=0),
-		formants(formants_!=0), in(), out() {
+		const double ratio_, const int crispness_, const int precise_, const int formants_,
+		const double pitch_) :
+		sampleRate(sampleRate_), ratio(ratio_), pitch(pitch_), crispness(crispness_), precise(precise_!=0),
+		formants(formants_!=0), channels(1), mutableBuffer(false), view(false), keyFrames(), blockSize(Stretch::BlockSize), nParallel(1), in(), out() {
 
 	mode=discriminate(stream);
+	mutableBuffer=PyByteArray_Check(stream);
 	if(mode==Content::Array) {
-		auto dtype = PyArray_DTYPE((PyArrayObject *)stream);
-		format=dtype->type_num;
+		format=arrayFormat(PyArray_DTYPE((PyArrayObject *)stream));
 	}
 	else {
 		format=format_;
 	}
 
-	if(Debug) {
-			std::cout << "Mode is " << names[mode] << std::endl;
-			std::cout << "Format is " << formatNames[format] << std::endl;
-		}
-
 	unpack(stream);
 }
 
-PyObject * PyTransformer::operator()() {
+PyTransformer::PyTransformer(const int format_,const unsigned channels_) :
+		sampleRate(48000), ratio(1.0), pitch(1.0), crispness(5), precise(true), formants(false),
+		format(format_), channels(channels_), mode(Content::Array), mutableBuffer(false), view(false), keyFrames(), blockSize(Stretch::BlockSize), nParallel(1), in(), out() {
+	if(formatNames.find(format)==formatNames.end()) throw std::runtime_error("Unsupported sample format");
+}
+
+PyObject * PyTransformer::pack(vect_t &&samples) {
+	out=std::move(samples);
+	return pack();
+}
+
+void PyTransformer::stretch() {
+	if(ratio<=0.0) throw std::invalid_argument("Ratio must be positive");
+	if(pitch<=0.0) throw std::invalid_argument("Pitch scale must be positive");
 	auto option=Stretch::makeOptions(crispness,formants,precise);
 	option |= RB::OptionThreadingNever;
-	if(Debug) {
-		std::cout << "Crispness is " << crispness << ", formants is " << formants << ", precise is " << precise << std::endl;
-		std::cout << "Option is " << std::hex << option << std::dec << std::endl;
-
-		std::cout << "N = " << in.size() << std::endl;
-		std::cout << "rate = " << sampleRate << std::endl;
-		std::cout << "ratio = " << ratio << std::endl;
-		std::cout << "option = " << option << std::endl;
-
-		std::cout << "In raw:" << std::endl;
-		for(auto i=0;i<100;i++) {
-			std::cout << in[i] << " ";
-			if(5== i%6) std::cout << std::endl;
-		}
-		std::cout << std::endl;
-	}
 
-	Stretch st(in.size(),1,sampleRate,ratio,option);
-	out = st(in);
+	Stretch st(in.size()/channels,channels,sampleRate,ratio,option,pitch);
+	st.setKeyFrames(keyFrames);
+	st.setBlockSize(blockSize);
+	if(nParallel>1) out = st.parallel(in.data(),in.size()/channels,nParallel);
+	else out = st(in);
+}
 
-	if(Debug) {
-		std::cout << "Out:" << std::endl;
-		for(auto i=0;i<100;i++) {
-			std::cout << out[i] << " ";
-			if(5== i%6) std::cout << std::endl;
-		}
-		std::cout << std::endl;
+PyObject * PyTransformer::operator()() {
+	{
+		GILRelease nogil;
+		stretch();
 	}
-
 	return pack();
 }
 
@@ -12,6 +12,7 @@
 #include <vector>
 #include <string>
 #include <map>
+#include "stretch.hpp"
 
 //
 // np.dtype <-> PyArray_Descr
@@ -22,8 +23,7 @@ enum class Content {
 	Array, List, Buffer
 };
 
-using vect_t = std::vector<double>;
-using range_t = std::pair<double,double>;
+using vect_t = std::vector<float>;
 
 
 
@@ -32,41 +32,60 @@ class PyTransformer {
 	
 private:
 	
-	static std::map<int,float> casts;
-	static std::map<int,range_t> ranges;
 	
 	
 	long sampleRate;
 	double ratio ;
+	double pitch ;
 	int crispness ;
 	bool precise ;
 	bool formants ;
 	int format;
+	unsigned channels;
 	
 	Content mode;
+	bool mutableBuffer;
+	bool view;
+	Stretch::KeyFrames keyFrames;
+	unsigned blockSize;
+	unsigned nParallel;
 	
 	vect_t in;
 	vect_t out;
 	
+	void samplesToVector(const char *data,const Py_ssize_t n,const Py_ssize_t stride);
 	void numpyToVector(PyObject *obj);
+	void vectorToSamples(char *data);
 	PyObject *vectorToNumpy();
 	void listToVector(PyObject *obj);
 	PyObject *vectorToList();
 	void bufferToVector(PyObject *obj);
 	PyObject *vectorToBuffer();
+	PyObject *vectorToView();
 	
 	void unpack(PyObject *stream);
-	PyObject *pack();
 		
 public:
-	static bool Debug;
+	static const int PCM24;
 	static std::map<int,std::string> formatNames;
 
 	PyTransformer(PyObject *stream, const int format_,const long sampleRate_=48000,
-		const double ratio_=1.0, const int crispness_=5, const int precise_=1, const int formants_=0);
+		const double ratio_=1.0, const int crispness_=5, const int precise_=1, const int formants_=0,
+		const double pitch_=1.0);
+	PyTransformer(const int format_,const unsigned channels_=1);
 	virtual ~PyTransformer() = default;
 	
+	void stretch();
 	PyObject * operator()();
+
+	const vect_t & samples() const { return in; }
+	unsigned channelCount() const { return channels; }
+	void returnView(const bool v) { view=v; }
+	void setKeyFrames(const Stretch::KeyFrames &frames) { keyFrames=frames; }
+	void setBlockSize(const unsigned size) { blockSize=size; }
+	void setParallel(const unsigned n) { nParallel=n; }
+	PyObject * pack();
+	PyObject * pack(vect_t &&samples);
 	
 	
 };
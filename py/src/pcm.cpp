@@ -0,0 +1,292 @@
+/*
+ * pcm.cpp
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "pcm.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PCM_X86 1
+#include <immintrin.h>
+#endif
+
+namespace pcm {
+
+#ifdef PCM_X86
+
+#define AVX2 __attribute__((target("avx2")))
+
+static bool hasAVX2() {
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	return avx2;
+}
+
+//
+// SSE2 kernels, used without dispatch (see pcm.hpp)
+//
+
+template<typename T>
+struct SSE {
+	__m128 scale = _mm_set1_ps(Traits<T>::scale);
+	__m128 inverse = _mm_set1_ps(1.0f/Traits<T>::scale);
+	__m128 offset = _mm_set1_ps(Traits<T>::offset);
+	__m128 lo = _mm_set1_ps(Traits<T>::lo);
+	__m128 hi = _mm_set1_ps(Traits<T>::hi);
+
+	void store(float *out,const __m128i v) const {
+		_mm_storeu_ps(out,_mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(v),offset),inverse));
+	}
+	__m128i load(const float *in) const {
+		auto x=_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in),scale),offset);
+		return _mm_cvtps_epi32(_mm_min_ps(hi,_mm_max_ps(lo,x)));
+	}
+};
+
+static size_t decodeSSE(const int8_t *in,const size_t n,float *out) {
+	SSE<int8_t> k;
+	size_t i=0;
+	for(;i+16<=n;i+=16) {
+		auto v=_mm_loadu_si128((const __m128i *)(in+i));
+		auto w0=_mm_srai_epi16(_mm_unpacklo_epi8(v,v),8);
+		auto w1=_mm_srai_epi16(_mm_unpackhi_epi8(v,v),8);
+		k.store(out+i,_mm_srai_epi32(_mm_unpacklo_epi16(w0,w0),16));
+		k.store(out+i+4,_mm_srai_epi32(_mm_unpackhi_epi16(w0,w0),16));
+		k.store(out+i+8,_mm_srai_epi32(_mm_unpacklo_epi16(w1,w1),16));
+		k.store(out+i+12,_mm_srai_epi32(_mm_unpackhi_epi16(w1,w1),16));
+	}
+	return i;
+}
+
+static size_t decodeSSE(const uint8_t *in,const size_t n,float *out) {
+	SSE<uint8_t> k;
+	auto zero=_mm_setzero_si128();
+	size_t i=0;
+	for(;i+16<=n;i+=16) {
+		auto v=_mm_loadu_si128((const __m128i *)(in+i));
+		auto w0=_mm_unpacklo_epi8(v,zero);
+		auto w1=_mm_unpackhi_epi8(v,zero);
+		k.store(out+i,_mm_unpacklo_epi16(w0,zero));
+		k.store(out+i+4,_mm_unpackhi_epi16(w0,zero));
+		k.store(out+i+8,_mm_unpacklo_epi16(w1,zero));
+		k.store(out+i+12,_mm_unpackhi_epi16(w1,zero));
+	}
+	return i;
+}
+
+static size_t decodeSSE(const int16_t *in,const size_t n,float *out) {
+	SSE<int16_t> k;
+	size_t i=0;
+	for(;i+8<=n;i+=8) {
+		auto v=_mm_loadu_si128((const __m128i *)(in+i));
+		k.store(out+i,_mm_srai_epi32(_mm_unpacklo_epi16(v,v),16));
+		k.store(out+i+4,_mm_srai_epi32(_mm_unpackhi_epi16(v,v),16));
+	}
+	return i;
+}
+
+static size_t decodeSSE(const int32_t *in,const size_t n,float *out) {
+	SSE<int32_t> k;
+	size_t i=0;
+	for(;i+4<=n;i+=4) k.store(out+i,_mm_loadu_si128((const __m128i *)(in+i)));
+	return i;
+}
+
+static size_t encodeSSE(const float *in,const size_t n,int8_t *out) {
+	SSE<int8_t> k;
+	size_t i=0;
+	for(;i+16<=n;i+=16) {
+		auto ab=_mm_packs_epi32(k.load(in+i),k.load(in+i+4));
+		auto cd=_mm_packs_epi32(k.load(in+i+8),k.load(in+i+12));
+		_mm_storeu_si128((__m128i *)(out+i),_mm_packs_epi16(ab,cd));
+	}
+	return i;
+}
+
+static size_t encodeSSE(const float *in,const size_t n,uint8_t *out) {
+	SSE<uint8_t> k;
+	size_t i=0;
+	for(;i+16<=n;i+=16) {
+		auto ab=_mm_packs_epi32(k.load(in+i),k.load(in+i+4));
+		auto cd=_mm_packs_epi32(k.load(in+i+8),k.load(in+i+12));
+		_mm_storeu_si128((__m128i *)(out+i),_mm_packus_epi16(ab,cd));
+	}
+	return i;
+}
+
+static size_t encodeSSE(const float *in,const size_t n,int16_t *out) {
+	SSE<int16_t> k;
+	size_t i=0;
+	for(;i+8<=n;i+=8) {
+		_mm_storeu_si128((__m128i *)(out+i),_mm_packs_epi32(k.load(in+i),k.load(in+i+4)));
+	}
+	return i;
+}
+
+static size_t encodeSSE(const float *in,const size_t n,int32_t *out) {
+	SSE<int32_t> k;
+	size_t i=0;
+	for(;i+4<=n;i+=4) _mm_storeu_si128((__m128i *)(out+i),k.load(in+i));
+	return i;
+}
+
+//
+// AVX2 versions, compiled for that target and chosen at run time
+//
+
+template<typename T>
+struct AVX {
+	__m256 scale, inverse, offset, lo, hi;
+
+	AVX2 AVX() : scale(_mm256_set1_ps(Traits<T>::scale)), inverse(_mm256_set1_ps(1.0f/Traits<T>::scale)),
+			offset(_mm256_set1_ps(Traits<T>::offset)), lo(_mm256_set1_ps(Traits<T>::lo)), hi(_mm256_set1_ps(Traits<T>::hi)) {};
+
+	AVX2 void store(float *out,const __m256i v) const {
+		_mm256_storeu_ps(out,_mm256_mul_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(v),offset),inverse));
+	}
+	AVX2 __m256i load(const float *in) const {
+		auto x=_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(in),scale),offset);
+		return _mm256_cvtps_epi32(_mm256_min_ps(hi,_mm256_max_ps(lo,x)));
+	}
+};
+
+AVX2 static size_t decodeAVX(const int8_t *in,const size_t n,float *out) {
+	AVX<int8_t> k;
+	size_t i=0;
+	for(;i+8<=n;i+=8) k.store(out+i,_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(in+i))));
+	return i;
+}
+
+AVX2 static size_t decodeAVX(const uint8_t *in,const size_t n,float *out) {
+	AVX<uint8_t> k;
+	size_t i=0;
+	for(;i+8<=n;i+=8) k.store(out+i,_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(in+i))));
+	return i;
+}
+
+AVX2 static size_t decodeAVX(const int16_t *in,const size_t n,float *out) {
+	AVX<int16_t> k;
+	size_t i=0;
+	for(;i+8<=n;i+=8) k.store(out+i,_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in+i))));
+	return i;
+}
+
+AVX2 static size_t decodeAVX(const int32_t *in,const size_t n,float *out) {
+	AVX<int32_t> k;
+	size_t i=0;
+	for(;i+8<=n;i+=8) k.store(out+i,_mm256_loadu_si256((const __m256i *)(in+i)));
+	return i;
+}
+
+// The 256-bit packs work within 128-bit lanes, so results are permuted back into order
+
+AVX2 static size_t encodeAVX(const float *in,const size_t n,int8_t *out) {
+	AVX<int8_t> k;
+	auto order=_mm256_setr_epi32(0,4,1,5,2,6,3,7);
+	size_t i=0;
+	for(;i+32<=n;i+=32) {
+		auto ab=_mm256_packs_epi32(k.load(in+i),k.load(in+i+8));
+		auto cd=_mm256_packs_epi32(k.load(in+i+16),k.load(in+i+24));
+		auto v=_mm256_permutevar8x32_epi32(_mm256_packs_epi16(ab,cd),order);
+		_mm256_storeu_si256((__m256i *)(out+i),v);
+	}
+	return i;
+}
+
+AVX2 static size_t encodeAVX(const float *in,const size_t n,uint8_t *out) {
+	AVX<uint8_t> k;
+	auto order=_mm256_setr_epi32(0,4,1,5,2,6,3,7);
+	size_t i=0;
+	for(;i+32<=n;i+=32) {
+		auto ab=_mm256_packs_epi32(k.load(in+i),k.load(in+i+8));
+		auto cd=_mm256_packs_epi32(k.load(in+i+16),k.load(in+i+24));
+		auto v=_mm256_permutevar8x32_epi32(_mm256_packus_epi16(ab,cd),order);
+		_mm256_storeu_si256((__m256i *)(out+i),v);
+	}
+	return i;
+}
+
+AVX2 static size_t encodeAVX(const float *in,const size_t n,int16_t *out) {
+	AVX<int16_t> k;
+	size_t i=0;
+	for(;i+16<=n;i+=16) {
+		auto v=_mm256_packs_epi32(k.load(in+i),k.load(in+i+8));
+		_mm256_storeu_si256((__m256i *)(out+i),_mm256_permute4x64_epi64(v,0xD8));
+	}
+	return i;
+}
+
+AVX2 static size_t encodeAVX(const float *in,const size_t n,int32_t *out) {
+	AVX<int32_t> k;
+	size_t i=0;
+	for(;i+8<=n;i+=8) _mm256_storeu_si256((__m256i *)(out+i),k.load(in+i));
+	return i;
+}
+
+template<typename T>
+void decode(const T *in,const size_t n,float *out) {
+	auto done = hasAVX2() ? decodeAVX(in,n,out) : decodeSSE(in,n,out);
+	reference::decode(in+done,n-done,out+done);
+}
+
+template<typename T>
+void encode(const float *in,const size_t n,T *out) {
+	auto done = hasAVX2() ? encodeAVX(in,n,out) : encodeSSE(in,n,out);
+	reference::encode(in+done,n-done,out+done);
+}
+
+const char *kernel() {
+	return hasAVX2() ? "avx2" : "sse2";
+}
+
+#else
+
+template<typename T>
+void decode(const T *in,const size_t n,float *out) {
+	reference::decode(in,n,out);
+}
+
+template<typename T>
+void encode(const float *in,const size_t n,T *out) {
+	reference::encode(in,n,out);
+}
+
+const char *kernel() {
+	return "scalar";
+}
+
+#endif
+
+// No vector kernels for these: the scalar loops are already a single pass
+
+template<>
+void decode<int24_t>(const int24_t *in,const size_t n,float *out) {
+	reference::decode(in,n,out);
+}
+
+template<>
+void encode<int24_t>(const float *in,const size_t n,int24_t *out) {
+	reference::encode(in,n,out);
+}
+
+template<>
+void decode<int64_t>(const int64_t *in,const size_t n,float *out) {
+	reference::decode(in,n,out);
+}
+
+template<>
+void encode<int64_t>(const float *in,const size_t n,int64_t *out) {
+	reference::encode(in,n,out);
+}
+
+template void decode<int8_t>(const int8_t *,const size_t,float *);
+template void decode<uint8_t>(const uint8_t *,const size_t,float *);
+template void decode<int16_t>(const int16_t *,const size_t,float *);
+template void decode<int32_t>(const int32_t *,const size_t,float *);
+
+template void encode<int8_t>(const float *,const size_t,int8_t *);
+template void encode<uint8_t>(const float *,const size_t,uint8_t *);
+template void encode<int16_t>(const float *,const size_t,int16_t *);
+template void encode<int32_t>(const float *,const size_t,int32_t *);
+
+}
@@ -0,0 +1,135 @@
+/*
+ * pcm.hpp
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef SRC_PCM_HPP_
+#define SRC_PCM_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+// Conversion between integer PCM and normalised float32 samples.
+//
+// Decoding divides by the full-scale value, so every format maps onto [-1,1).
+// Encoding scales, clamps to the format's range and rounds to nearest (ties to
+// even, which is what the vector conversions do), so the SIMD kernels and the
+// scalar reference agree bit for bit.  PCM_U8 is offset binary, centred on 128,
+// and PCM_24 is packed little-endian three-byte samples.
+//
+// On x86 the kernels use SSE2 unconditionally, as it is part of the x86-64
+// baseline, and pick AVX2 versions at run time where the CPU has them.
+
+namespace pcm {
+
+struct int24_t {
+	uint8_t bytes[3];
+};
+static_assert(sizeof(int24_t)==3,"int24_t must be packed");
+
+template<typename T>
+struct Traits;
+
+template<typename T>
+struct Integer {
+	static long long value(const T x) { return x; }
+	static T make(const long long v) { return (T)v; }
+};
+
+template<>
+struct Traits<int8_t> : Integer<int8_t> {
+	static constexpr float scale = 128.0f;
+	static constexpr float offset = 0.0f;
+	static constexpr float lo = -128.0f;
+	static constexpr float hi = 127.0f;
+};
+
+template<>
+struct Traits<uint8_t> : Integer<uint8_t> {
+	static constexpr float scale = 128.0f;
+	static constexpr float offset = 128.0f;
+	static constexpr float lo = 0.0f;
+	static constexpr float hi = 255.0f;
+};
+
+template<>
+struct Traits<int16_t> : Integer<int16_t> {
+	static constexpr float scale = 32768.0f;
+	static constexpr float offset = 0.0f;
+	static constexpr float lo = -32768.0f;
+	static constexpr float hi = 32767.0f;
+};
+
+template<>
+struct Traits<int32_t> : Integer<int32_t> {
+	static constexpr float scale = 2147483648.0f;
+	static constexpr float offset = 0.0f;
+	static constexpr float lo = -2147483648.0f;
+	static constexpr float hi = 2147483520.0f;	// largest float below 2^31
+};
+
+template<>
+struct Traits<int24_t> {
+	static constexpr float scale = 8388608.0f;
+	static constexpr float offset = 0.0f;
+	static constexpr float lo = -8388608.0f;
+	static constexpr float hi = 8388607.0f;
+
+	static long long value(const int24_t x) {
+		int32_t v = x.bytes[0] | (x.bytes[1]<<8) | (x.bytes[2]<<16);
+		return (v ^ 0x800000) - 0x800000;
+	}
+	static int24_t make(const long long v) {
+		return { { (uint8_t)v, (uint8_t)(v>>8), (uint8_t)(v>>16) } };
+	}
+};
+
+template<>
+struct Traits<int64_t> : Integer<int64_t> {
+	static constexpr float scale = 9223372036854775808.0f;
+	static constexpr float offset = 0.0f;
+	static constexpr float lo = -9223372036854775808.0f;
+	static constexpr float hi = 9223371487098961920.0f;	// largest float below 2^63
+};
+
+// The integer sample value a normalised float encodes to
+
+template<typename T>
+long long quantise(const float x) {
+	using tr = Traits<T>;
+	return (long long)std::nearbyint(std::min(tr::hi,std::max(tr::lo,x*tr::scale+tr::offset)));
+}
+
+namespace reference {
+
+template<typename T>
+void decode(const T *in,const size_t n,float *out) {
+	using tr = Traits<T>;
+	for(size_t i=0;i<n;i++) out[i]=((float)tr::value(in[i])-tr::offset)*(1.0f/tr::scale);
+}
+
+template<typename T>
+void encode(const float *in,const size_t n,T *out) {
+	for(size_t i=0;i<n;i++) out[i]=Traits<T>::make(quantise<T>(in[i]));
+}
+
+}
+
+template<typename T>
+void decode(const T *in,const size_t n,float *out);
+
+template<typename T>
+void encode(const float *in,const size_t n,T *out);
+
+// The name of the instruction set the kernels were dispatched to
+
+const char *kernel();
+
+}
+
+
+
+#endif /* SRC_PCM_HPP_ */
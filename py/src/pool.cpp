@@ -0,0 +1,77 @@
+/*
+ * pool.cpp
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "pool.hpp"
+
+StretcherPool & StretcherPool::shared() {
+	static StretcherPool pool;
+	return pool;
+}
+
+StretcherPool::Handle StretcherPool::acquire(const size_t rate,const size_t channels,const RB::Options options,const double ratio,const double pitch) {
+	Handle stretcher;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		auto it=idle.find(Key(rate,channels,options));
+		if(it!=idle.end() && !it->second.empty()) {
+			stretcher=std::move(it->second.back());
+			it->second.pop_back();
+			nIdle--;
+			nHits++;
+		}
+		else {
+			nMisses++;
+		}
+	}
+	if(!stretcher) return Handle(new RB(rate,channels,options,ratio,pitch));
+
+	stretcher->reset();
+	stretcher->setTimeRatio(ratio);
+	stretcher->setPitchScale(pitch);
+	return stretcher;
+}
+
+void StretcherPool::release(const size_t rate,const size_t channels,const RB::Options options,Handle &&stretcher) {
+	if(!stretcher) return;
+	Handle discard;
+	std::lock_guard<std::mutex> guard(lock);
+	if(nIdle<nCapacity) {
+		idle[Key(rate,channels,options)].push_back(std::move(stretcher));
+		nIdle++;
+	}
+	else {
+		discard=std::move(stretcher);
+	}
+}
+
+void StretcherPool::trim() {
+	for(auto it=idle.begin();it!=idle.end() && nIdle>nCapacity;) {
+		auto &stack=it->second;
+		while(!stack.empty() && nIdle>nCapacity) {
+			stack.pop_back();
+			nIdle--;
+		}
+		if(stack.empty()) it=idle.erase(it);
+		else it++;
+	}
+}
+
+void StretcherPool::resize(const unsigned long capacity_) {
+	std::lock_guard<std::mutex> guard(lock);
+	nCapacity=capacity_;
+	trim();
+}
+
+StretcherPool::Stats StretcherPool::stats() {
+	std::lock_guard<std::mutex> guard(lock);
+	return { nCapacity, nIdle, nHits, nMisses };
+}
+
+void StretcherPool::resetStats() {
+	std::lock_guard<std::mutex> guard(lock);
+	nHits=0;
+	nMisses=0;
+}
@@ -0,0 +1,64 @@
+/*
+ * pool.hpp
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef SRC_POOL_HPP_
+#define SRC_POOL_HPP_
+
+#include <map>
+#include <tuple>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <rubberband/RubberBandStretcher.h>
+
+// Process-wide cache of idle stretchers, so that repeated calls with the same
+// sample rate, channel count and options reuse FFT plans and window tables
+// rather than building them afresh.  Stretchers are reset as they are checked
+// out.  At most capacity() stretchers are kept idle; beyond that they are freed.
+
+class StretcherPool {
+public:
+	using RB = RubberBand::RubberBandStretcher;
+	using Handle = std::unique_ptr<RB>;
+
+	struct Stats {
+		unsigned long capacity;
+		unsigned long idle;
+		unsigned long hits;
+		unsigned long misses;
+	};
+
+private:
+	using Key = std::tuple<size_t,size_t,RB::Options>;
+
+	std::mutex lock;
+	std::map<Key,std::vector<Handle>> idle;
+	unsigned long nIdle=0;
+	unsigned long nCapacity;
+	unsigned long nHits=0;
+	unsigned long nMisses=0;
+
+	void trim();
+
+public:
+	StretcherPool(const unsigned long capacity_ = 16) : nCapacity(capacity_) {};
+	virtual ~StretcherPool() = default;
+	StretcherPool(const StretcherPool &) = delete;
+	StretcherPool & operator=(const StretcherPool &) = delete;
+
+	static StretcherPool & shared();
+
+	Handle acquire(const size_t rate,const size_t channels,const RB::Options options,const double ratio,const double pitch);
+	void release(const size_t rate,const size_t channels,const RB::Options options,Handle &&stretcher);
+
+	void resize(const unsigned long capacity_);
+	Stats stats();
+	void resetStats();
+};
+
+
+
+#endif /* SRC_POOL_HPP_ */
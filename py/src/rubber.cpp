@@ -15,26 +15,95 @@
 #include <sstream>
 #include <iostream>
 #include <stdexcept>
+#include <mutex>
+#include <cmath>
 
 #define PY_ARRAY_UNIQUE_SYMBOL rubberband_ARRAY_API
 #include <arrayobject.h>
 
 #include "stretch.hpp"
 #include "numpy.hpp"
+#include "gil.hpp"
+#include "workers.hpp"
+#include "pool.hpp"
+#include "stats.hpp"
+#include "files.hpp"
 
 
-static const bool Debug = false;
 static PyObject *rubberbandError;
 
 const char* ModuleName="rubberband";
 const char* ErrorName="RubberBandError";
-static char *Keywords[]={"data","format","rate","ratio","crispness","formants","precise",NULL};
+static char *Keywords[]={"data","format","rate","ratio","crispness","formants","precise","view","pitch","keyframes","block_size","parallel",NULL};
+static char *ShiftKeywords[]={"data","semitones","format","rate","crispness","formants","precise","view",NULL};
+static char *FileKeywords[]={"src","dst","ratio","duration","format","crispness","formants","precise","pitch","block_size",NULL};
 
 
 
 
-static PyObject * stretch(PyObject *self, PyObject *args, PyObject *keywds) {
-	PyTransformer::Debug=Debug;
+// Bad argument values are thrown as std::invalid_argument and raised as
+// ValueError; everything else is a RubberBandError.
+
+static PyObject * errorFor(const std::exception &e) {
+	return (dynamic_cast<const std::invalid_argument *>(&e)!=nullptr) ? PyExc_ValueError : rubberbandError;
+}
+
+// Key frames come as a sequence of (input frame, output frame) pairs, or as a
+// dict mapping one to the other.
+
+static Stretch::KeyFrames keyFrameMap(PyObject *keyframes) {
+	static const char *message="Key frames must be a sequence of (input, output) frame pairs";
+	PyObject *items = PyDict_Check(keyframes) ? PyDict_Items(keyframes) : PySequence_Fast(keyframes,message);
+	if(items==NULL) throw std::invalid_argument(message);
+	PyObject *seq=PySequence_Fast(items,message);
+	Py_DECREF(items);
+	if(seq==NULL) throw std::invalid_argument(message);
+
+	// Any pair will do: tuples, lists, or the rows of an (N, 2) array
+	Stretch::KeyFrames frames;
+	bool ok=true;
+	auto n=PySequence_Fast_GET_SIZE(seq);
+	for(auto i=0;ok && i<n;i++) {
+		PyObject *pair=PySequence_Fast(PySequence_Fast_GET_ITEM(seq,i),message);
+		if(pair==NULL || PySequence_Fast_GET_SIZE(pair)!=2) {
+			Py_XDECREF(pair);
+			ok=false;
+			break;
+		}
+		auto from=PyLong_AsLongLong(PySequence_Fast_GET_ITEM(pair,0));
+		auto to=PyLong_AsLongLong(PySequence_Fast_GET_ITEM(pair,1));
+		Py_DECREF(pair);
+		ok = !PyErr_Occurred() && from>=0 && to>=0;
+		if(ok) frames[from]=to;
+	}
+	Py_DECREF(seq);
+	if(!ok) {
+		PyErr_Clear();
+		throw std::invalid_argument(message);
+	}
+	return frames;
+}
+
+// A block size is a positive number of frames, or "auto"
+
+static unsigned blockSizeValue(PyObject *size) {
+	if(PyUnicode_Check(size)) {
+		if(PyUnicode_CompareWithASCIIString(size,"auto")==0) return Stretch::AutoBlockSize;
+		throw std::invalid_argument("Block size must be a positive integer or \"auto\"");
+	}
+	auto value=PyLong_AsLong(size);
+	if(value==-1 && PyErr_Occurred()) {
+		PyErr_Clear();
+		throw std::invalid_argument("Block size must be a positive integer or \"auto\"");
+	}
+	if(value<1 || value>(1<<20)) throw std::invalid_argument("Block size must be between 1 and 1048576 frames");
+	return (unsigned)value;
+}
+
+// Builds a transformer, with its input unpacked, from the arguments to stretch.
+// Returns null with a Python error set if the arguments don't parse.
+
+static std::unique_ptr<PyTransformer> transformerFor(PyObject *args, PyObject *keywds) {
 	PyObject *stream;
 	long sampleRate=64000;
 	double ratio=1.0;
@@ -42,26 +111,571 @@ static PyObject * stretch(PyObject *self, PyObject *args, PyObject *keywds) {
 	int precise=0;
 	int formants=0;
 	int fmt = NPY_FLOAT;
+	int view=0;
+	double pitch=1.0;
+	PyObject *keyframes=NULL;
+	PyObject *blockSize=NULL;
+	int parallel=1;
+
+	if(!PyArg_ParseTupleAndKeywords(args,keywds,"O|ildipppdOOi",Keywords,
+			&stream,&fmt,&sampleRate,&ratio,&crispness,&formants,&precise,&view,&pitch,&keyframes,&blockSize,&parallel)) { return nullptr; }
+
+	if(ratio<=0.0) throw std::invalid_argument("Ratio must be positive");
+	if(parallel<1) throw std::invalid_argument("Parallel must be a positive number of segments");
+	if(pitch<=0.0) throw std::invalid_argument("Pitch scale must be positive");
 
-	if(!PyArg_ParseTupleAndKeywords(args,keywds,"O|ildipp",Keywords,
-			&stream,&fmt,&sampleRate,&ratio,&crispness,&formants,&precise)) { return NULL; }
+	std::unique_ptr<PyTransformer> transformer(new PyTransformer(stream,fmt,sampleRate,ratio,crispness,precise,formants,pitch));
+	transformer->returnView(view);
+	if(keyframes!=NULL && keyframes!=Py_None) transformer->setKeyFrames(keyFrameMap(keyframes));
+	if(blockSize!=NULL) transformer->setBlockSize(blockSizeValue(blockSize));
+	transformer->setParallel(parallel);
+	return transformer;
+}
 
+static PyObject * stretch(PyObject *self, PyObject *args, PyObject *keywds) {
 	try {
-		PyTransformer transformer(stream,fmt,sampleRate,ratio,crispness,precise,formants);
-		PyObject *o = transformer();
-		Py_INCREF(o);
-		return (PyObject *)o;
+		auto transformer=transformerFor(args,keywds);
+		if(!transformer) return nullptr;
+		return (*transformer)();
 	}
 	catch(std::exception &e) {
-		PyErr_SetString(rubberbandError,e.what());
-		if(Debug) std::cerr << e.what();
+		PyErr_SetString(errorFor(e),e.what());
 		return nullptr;
 	}
+}
+
+// stretch_async unpacks its input at once, then queues the stretch on a native
+// worker that runs without the GIL.  When it is done, the worker takes the GIL
+// just long enough to pack the result and hand it to the event loop with
+// call_soon_threadsafe, and the loop completes the future.
+
+static PyObject *completeFunction;
+
+static PyObject * complete(PyObject *self, PyObject *args) {
+	PyObject *future, *value;
+	int failed;
+	if(!PyArg_ParseTuple(args,"OOp",&future,&value,&failed)) return nullptr;
 
+	auto cancelled=PyObject_CallMethod(future,"cancelled",NULL);
+	if(cancelled==NULL) return nullptr;
+	auto skip=PyObject_IsTrue(cancelled);
+	Py_DECREF(cancelled);
+	if(skip) Py_RETURN_NONE;
+	return PyObject_CallMethod(future,failed ? "set_exception" : "set_result","O",value);
+}
+
+static PyMethodDef CompleteDef = {"_complete",(PyCFunction) complete, METH_VARARGS, "Complete a stretch_async future"};
+
+static workers::Queue & asyncQueue() {
+	static workers::Queue *queue = new workers::Queue();
+	return *queue;
+}
+
+static void finishAsync(PyTransformer *transformer,const std::string &error,PyObject *loop,PyObject *future) {
+	PyObject *value=nullptr;
+	bool failed=!error.empty();
+	if(!failed) {
+		try {
+			value=transformer->pack();
+		}
+		catch(std::exception &e) {
+			PyErr_SetString(errorFor(e),e.what());
+		}
+		if(value==nullptr) {
+			PyObject *type, *traceback;
+			PyErr_Fetch(&type,&value,&traceback);
+			PyErr_NormalizeException(&type,&value,&traceback);
+			Py_XDECREF(type);
+			Py_XDECREF(traceback);
+			failed=true;
+		}
+	}
+	else {
+		value=PyObject_CallFunction(rubberbandError,"s",error.c_str());
+	}
+	if(value!=nullptr) {
+		auto done=PyObject_CallMethod(loop,"call_soon_threadsafe","OOOO",completeFunction,future,value,failed ? Py_True : Py_False);
+		if(done==NULL) PyErr_WriteUnraisable(loop);
+		Py_XDECREF(done);
+		Py_DECREF(value);
+	}
+	else {
+		PyErr_WriteUnraisable(future);
+	}
+}
+
+static PyObject * stretch_async(PyObject *self, PyObject *args, PyObject *keywds) {
+	PyObject *asyncio=PyImport_ImportModule("asyncio");
+	if(asyncio==NULL) return nullptr;
+	PyObject *loop=PyObject_CallMethod(asyncio,"get_running_loop",NULL);
+	Py_DECREF(asyncio);
+	if(loop==NULL) return nullptr;
+	PyObject *future=PyObject_CallMethod(loop,"create_future",NULL);
+	if(future==NULL) {
+		Py_DECREF(loop);
+		return nullptr;
+	}
+
+	std::shared_ptr<PyTransformer> transformer;
+	try {
+		transformer=transformerFor(args,keywds);
+	}
+	catch(std::exception &e) {
+		PyErr_SetString(errorFor(e),e.what());
+	}
+	if(!transformer) {
+		Py_DECREF(loop);
+		Py_DECREF(future);
+		return nullptr;
+	}
+
+	Py_INCREF(future);
+	asyncQueue().submit([transformer,loop,future]() {
+		std::string error;
+		try {
+			transformer->stretch();
+		}
+		catch(std::exception &e) {
+			error=e.what();
+		}
+		auto state=PyGILState_Ensure();
+		finishAsync(transformer.get(),error,loop,future);
+		Py_DECREF(loop);
+		Py_DECREF(future);
+		PyGILState_Release(state);
+	});
+	return future;
+}
+
+static PyObject * shift(PyObject *self, PyObject *args, PyObject *keywds) {
+	PyObject *stream;
+	double semitones=0.0;
+	long sampleRate=64000;
+	int crispness=5;
+	int precise=0;
+	int formants=0;
+	int fmt = NPY_FLOAT;
+	int view=0;
+
+	if(!PyArg_ParseTupleAndKeywords(args,keywds,"O|dilippp",ShiftKeywords,
+			&stream,&semitones,&fmt,&sampleRate,&crispness,&formants,&precise,&view)) { return NULL; }
+
+	try {
+		PyTransformer transformer(stream,fmt,sampleRate,1.0,crispness,precise,formants,std::pow(2.0,semitones/12.0));
+		transformer.returnView(view);
+		return transformer();
+	}
+	catch(std::exception &e) {
+		PyErr_SetString(errorFor(e),e.what());
+		return nullptr;
+	}
+}
+
+// stretch_file decodes, stretches and encodes in blocks without the GIL, so
+// the samples never become Python objects; only a summary comes back.
+
+static PyObject * stretch_file(PyObject *self, PyObject *args, PyObject *keywds) {
+	PyObject *src=NULL;
+	PyObject *dst=NULL;
+	PyObject *ratio=Py_None;
+	PyObject *duration=Py_None;
+	const char *format=NULL;
+	int crispness=5;
+	int formants=0;
+	int precise=0;
+	double pitch=1.0;
+	PyObject *blockSize=NULL;
+
+	if(!PyArg_ParseTupleAndKeywords(args,keywds,"O&O&|OOzippdO",FileKeywords,
+			PyUnicode_FSConverter,&src,PyUnicode_FSConverter,&dst,&ratio,&duration,&format,
+			&crispness,&formants,&precise,&pitch,&blockSize)) {
+		Py_XDECREF(src);
+		return NULL;
+	}
+
+	FileJob job { PyBytes_AsString(src), PyBytes_AsString(dst), -1.0, 1.0, (format==NULL) ? "" : format, pitch };
+	Py_DECREF(src);
+	Py_DECREF(dst);
+	try {
+		if(ratio==Py_None && duration==Py_None) throw std::runtime_error("One of ratio or duration is required");
+		if(ratio!=Py_None && duration!=Py_None) throw std::runtime_error("Give only one of ratio or duration");
+		if(ratio!=Py_None) {
+			job.ratio=PyFloat_AsDouble(ratio);
+			if(PyErr_Occurred()) return NULL;
+			if(job.ratio<=0.0) throw std::invalid_argument("Ratio must be positive");
+		}
+		else {
+			job.duration=PyFloat_AsDouble(duration);
+			if(PyErr_Occurred()) return NULL;
+			if(job.duration<=0.0) throw std::invalid_argument("Duration must be positive");
+		}
+		if(pitch<=0.0) throw std::invalid_argument("Pitch scale must be positive");
+		auto block=(blockSize==NULL) ? Stretch::BlockSize : blockSizeValue(blockSize);
+		auto options=Stretch::makeOptions(crispness,formants,precise);
+
+		FileResult result;
+		{
+			GILRelease nogil;
+			result=stretchFile(job,options,block);
+		}
+		if(!result.ok) throw std::runtime_error(result.message);
+		return Py_BuildValue("{s:k,s:k,s:i,s:i,s:d,s:d,s:d,s:s}",
+				"frames_in",result.framesIn,"frames_out",result.framesOut,
+				"rate",result.rate,"channels",result.channels,
+				"duration_in",result.seconds,"duration_out",double(result.framesOut)/result.rate,
+				"ratio",result.ratio,"format",result.format.c_str());
+	}
+	catch(std::exception &e) {
+		PyErr_SetString(errorFor(e),e.what());
+		return nullptr;
+	}
+}
+
+typedef struct {
+	PyObject_HEAD
+	StretchStream *stream;
+	std::mutex *lock;
+	long sampleRate;
+	int format;
+} StretcherObject;
+
+static char *StretcherKeywords[]={"rate","channels","ratio","format","crispness","formants","precise",NULL};
+
+static PyObject * Stretcher_new(PyTypeObject *type, PyObject *args, PyObject *keywds) {
+	StretcherObject *self = (StretcherObject *)type->tp_alloc(type,0);
+	if(self!=NULL) {
+		self->stream=nullptr;
+		self->lock=nullptr;
+	}
+	return (PyObject *)self;
+}
+
+static int Stretcher_init(StretcherObject *self, PyObject *args, PyObject *keywds) {
+	long sampleRate=48000;
+	int channels=1;
+	double ratio=1.0;
+	int fmt = NPY_FLOAT;
+	int crispness=5;
+	int formants=0;
+	int precise=1;
+
+	if(!PyArg_ParseTupleAndKeywords(args,keywds,"|lidiipp",StretcherKeywords,
+			&sampleRate,&channels,&ratio,&fmt,&crispness,&formants,&precise)) { return -1; }
+
+	// Other threads may be using the stream with the GIL released, so it is
+	// never replaced once made.
+	try {
+		if(self->stream!=nullptr) throw std::runtime_error("Stretcher is already initialised");
+		if(channels<1) throw std::invalid_argument("Stretcher needs at least one channel");
+		if(ratio<=0.0) throw std::invalid_argument("Ratio must be positive");
+		if(PyTransformer::formatNames.find(fmt)==PyTransformer::formatNames.end()) throw std::invalid_argument("Unsupported sample format");
+		auto option=Stretch::makeOptions(crispness,formants,precise);
+		option |= RB::OptionThreadingNever;
+
+		self->stream=new StretchStream(channels,sampleRate,ratio,option);
+		if(self->lock==nullptr) self->lock=new std::mutex();
+		self->sampleRate=sampleRate;
+		self->format=fmt;
+		return 0;
+	}
+	catch(std::exception &e) {
+		PyErr_SetString(errorFor(e),e.what());
+		return -1;
+	}
+}
+
+static void Stretcher_dealloc(StretcherObject *self) {
+	delete self->stream;
+	delete self->lock;
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject * Stretcher_wrap(StretcherObject *self,std::vector<float> &&samples) {
+	PyTransformer transformer(self->format,self->stream->channels());
+	return transformer.pack(std::move(samples));
+}
+
+static PyObject * Stretcher_push(StretcherObject *self, PyObject *chunk) {
+	try {
+		if(self->stream==nullptr) throw std::runtime_error("Stretcher is not initialised");
+		PyTransformer transformer(chunk,self->format,self->sampleRate);
+		auto channels=self->stream->channels();
+		if(transformer.channelCount()>1 && transformer.channelCount()!=channels) throw std::runtime_error("Chunk has the wrong number of channels");
+
+		auto &samples=transformer.samples();
+		if(samples.size()%channels) throw std::runtime_error("Chunk is not a whole number of frames");
+		{
+			GILRelease nogil;
+			std::lock_guard<std::mutex> guard(*self->lock);
+			self->stream->push(samples.data(),samples.size()/channels);
+		}
+		Py_RETURN_NONE;
+	}
+	catch(std::exception &e) {
+		PyErr_SetString(errorFor(e),e.what());
+		return nullptr;
+	}
+}
+
+static PyObject * Stretcher_pull(StretcherObject *self, PyObject *Py_UNUSED(ignored)) {
+	try {
+		if(self->stream==nullptr) throw std::runtime_error("Stretcher is not initialised");
+		std::vector<float> out;
+		{
+			GILRelease nogil;
+			std::lock_guard<std::mutex> guard(*self->lock);
+			out=self->stream->pull();
+		}
+		return Stretcher_wrap(self,std::move(out));
+	}
+	catch(std::exception &e) {
+		PyErr_SetString(errorFor(e),e.what());
+		return nullptr;
+	}
+}
+
+static PyObject * Stretcher_flush(StretcherObject *self, PyObject *Py_UNUSED(ignored)) {
+	try {
+		if(self->stream==nullptr) throw std::runtime_error("Stretcher is not initialised");
+		std::vector<float> out;
+		{
+			GILRelease nogil;
+			std::lock_guard<std::mutex> guard(*self->lock);
+			out=self->stream->flush();
+		}
+		return Stretcher_wrap(self,std::move(out));
+	}
+	catch(std::exception &e) {
+		PyErr_SetString(errorFor(e),e.what());
+		return nullptr;
+	}
+}
+
+static PyObject * Stretcher_available(StretcherObject *self, PyObject *Py_UNUSED(ignored)) {
+	if(self->stream==nullptr) {
+		PyErr_SetString(rubberbandError,"Stretcher is not initialised");
+		return nullptr;
+	}
+	int available;
+	{
+		GILRelease nogil;
+		std::lock_guard<std::mutex> guard(*self->lock);
+		available=self->stream->available();
+	}
+	return PyLong_FromLong(available);
+}
+
+static PyObject * Stretcher_latency(StretcherObject *self, void *closure) {
+	if(self->stream==nullptr) {
+		PyErr_SetString(rubberbandError,"Stretcher is not initialised");
+		return nullptr;
+	}
+	unsigned latency;
+	{
+		GILRelease nogil;
+		std::lock_guard<std::mutex> guard(*self->lock);
+		latency=self->stream->latency();
+	}
+	return PyLong_FromUnsignedLong(latency);
+}
+
+static char *StatsKeywords[]={"reset",NULL};
+
+static PyObject * stats_(PyObject *self, PyObject *args, PyObject *keywds) {
+	int reset=0;
+	if(!PyArg_ParseTupleAndKeywords(args,keywds,"|p",StatsKeywords,&reset)) { return NULL; }
+
+	auto totals=stats::read();
+	if(reset) stats::reset();
+	PyObject *dict=PyDict_New();
+	if(dict==NULL) return NULL;
+	for(unsigned i=0;i<stats::NStages;i++) {
+		auto stage=Py_BuildValue("{s:d,s:K}","seconds",1.0e-9*totals.ns[i],"calls",(unsigned long long)totals.calls[i]);
+		if(stage==NULL || PyDict_SetItemString(dict,stats::name((stats::Stage)i),stage)<0) {
+			Py_XDECREF(stage);
+			Py_DECREF(dict);
+			return NULL;
+		}
+		Py_DECREF(stage);
+	}
+	for(unsigned i=0;i<stats::NCounters;i++) {
+		auto value=PyLong_FromUnsignedLongLong(totals.counters[i]);
+		if(value==NULL || PyDict_SetItemString(dict,stats::name((stats::Counter)i),value)<0) {
+			Py_XDECREF(value);
+			Py_DECREF(dict);
+			return NULL;
+		}
+		Py_DECREF(value);
+	}
+	return dict;
+}
+
+static char *PoolStatsKeywords[]={"reset",NULL};
+
+static PyObject * pool_stats(PyObject *self, PyObject *args, PyObject *keywds) {
+	int reset=0;
+	if(!PyArg_ParseTupleAndKeywords(args,keywds,"|p",PoolStatsKeywords,&reset)) { return NULL; }
+
+	auto &pool=StretcherPool::shared();
+	auto stats=pool.stats();
+	if(reset) pool.resetStats();
+	return Py_BuildValue("{s:k,s:k,s:k,s:k}","capacity",stats.capacity,"idle",stats.idle,
+			"hits",stats.hits,"misses",stats.misses);
+}
+
+static PyObject * set_pool_size(PyObject *self, PyObject *arg) {
+	auto size=PyLong_AsLong(arg);
+	if(size==-1 && PyErr_Occurred()) return nullptr;
+	if(size<0) {
+		PyErr_SetString(rubberbandError,"Pool size must be non-negative");
+		return nullptr;
+	}
+	{
+		GILRelease nogil;
+		StretcherPool::shared().resize(size);
+	}
+	Py_RETURN_NONE;
+}
+
+static struct PyMethodDef StretcherMethods[] = {
+		{"push",(PyCFunction) Stretcher_push, METH_O, "Push a chunk of audio into the stretcher"},
+		{"pull",(PyCFunction) Stretcher_pull, METH_NOARGS, "Retrieve all stretched audio available so far"},
+		{"flush",(PyCFunction) Stretcher_flush, METH_NOARGS, "Mark the end of the input, retrieve the remaining audio and reset"},
+		{"available",(PyCFunction) Stretcher_available, METH_NOARGS, "Number of stretched frames ready to pull"},
+		{NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef StretcherGetSet[] = {
+		{"latency",(getter) Stretcher_latency, NULL, "Processing latency of the stretcher, in frames", NULL},
+		{NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyTypeObject StretcherType = {
+		PyVarObject_HEAD_INIT(NULL, 0)
+};
+
+static char *ManyKeywords[]={"data","ratios","format","rate","crispness","formants","precise","workers","view",NULL};
+
+// numpy arrays pass PyNumber_Check too, so anything with a length is taken as
+// a sequence first; only what has none is taken as a single ratio.
+
+static bool isSequence(PyObject *o) {
+	if(!PySequence_Check(o)) return false;
+	if(PySequence_Size(o)>=0) return true;
+	PyErr_Clear();
+	return false;
+}
+
+static std::vector<double> ratioList(PyObject *ratios,const unsigned long n) {
+	if(!isSequence(ratios)) {
+		auto ratio=PyFloat_AsDouble(ratios);
+		if(PyErr_Occurred()) throw std::invalid_argument("Ratio must be a number");
+		return std::vector<double>(n,ratio);
+	}
+	PyObject *seq=PySequence_Fast(ratios,"Ratios must be a number or a sequence of numbers");
+	if(seq==NULL) throw std::invalid_argument("Ratios must be a number or a sequence of numbers");
+	std::vector<double> out;
+	auto m=PySequence_Fast_GET_SIZE(seq);
+	for(auto i=0;i<m;i++) out.push_back(PyFloat_AsDouble(PySequence_Fast_GET_ITEM(seq,i)));
+	Py_DECREF(seq);
+	if(PyErr_Occurred()) throw std::invalid_argument("Ratios must be a number or a sequence of numbers");
+	if(out.size()!=n) throw std::invalid_argument("Need one ratio per input");
+	return out;
+}
+
+static PyObject * stretch_many(PyObject *self, PyObject *args, PyObject *keywds) {
+	PyObject *streams;
+	PyObject *ratios=NULL;
+	long sampleRate=64000;
+	int crispness=5;
+	int precise=0;
+	int formants=0;
+	int fmt = NPY_FLOAT;
+	int nWorkers=workers::defaultCount();
+	int view=0;
+
+	if(!PyArg_ParseTupleAndKeywords(args,keywds,"O|Oilippip",ManyKeywords,
+			&streams,&ratios,&fmt,&sampleRate,&crispness,&formants,&precise,&nWorkers,&view)) { return NULL; }
+	if(nWorkers<1) {
+		PyErr_SetString(PyExc_ValueError,"Workers must be a positive number of threads");
+		return NULL;
+	}
+
+	PyObject *seq=nullptr;
+	try {
+		seq=PySequence_Fast(streams,"Input data must be a sequence of streams");
+		if(seq==NULL) return NULL;
+		unsigned long n=PySequence_Fast_GET_SIZE(seq);
+		auto rs = (ratios==NULL) ? std::vector<double>(n,1.0) : ratioList(ratios,n);
+
+		std::vector<std::unique_ptr<PyTransformer>> transformers(n);
+		std::vector<std::string> errors(n);
+		std::vector<PyObject *> kinds(n,rubberbandError);
+		for(unsigned long i=0;i<n;i++) {
+			try {
+				if(rs[i]<=0.0) throw std::invalid_argument("Ratio must be positive");
+				auto stream=PySequence_Fast_GET_ITEM(seq,i);
+				transformers[i].reset(new PyTransformer(stream,fmt,sampleRate,rs[i],crispness,precise,formants));
+				transformers[i]->returnView(view);
+			}
+			catch(std::exception &e) {
+				errors[i]=e.what();
+				kinds[i]=errorFor(e);
+			}
+		}
+
+		{
+			GILRelease nogil;
+			workers::parallel(n,nWorkers,[&transformers,&errors,&kinds](const unsigned long i) {
+				if(!transformers[i]) return;
+				try {
+					transformers[i]->stretch();
+				}
+				catch(std::exception &e) {
+					errors[i]=e.what();
+					kinds[i]=errorFor(e);
+					transformers[i].reset();
+				}
+			});
+		}
+
+		PyObject *results=PyList_New(n);
+		if(results==NULL) throw std::runtime_error("Cannot allocate list");
+		for(unsigned long i=0;i<n;i++) {
+			PyObject *item=nullptr;
+			if(transformers[i]) {
+				try {
+					item=transformers[i]->pack();
+				}
+				catch(std::exception &e) {
+					errors[i]=e.what();
+				}
+			}
+			if(item==nullptr) {
+				PyErr_Clear();
+				item=PyObject_CallFunction(kinds[i],"s",errors[i].c_str());
+			}
+			PyList_SET_ITEM(results,i,item);
+		}
+		Py_DECREF(seq);
+		return results;
+	}
+	catch(std::exception &e) {
+		Py_XDECREF(seq);
+		PyErr_SetString(errorFor(e),e.what());
+		return nullptr;
+	}
 }
 
 static struct PyMethodDef methods[] = {
 		{"stretch",(PyCFunction) stretch, METH_VARARGS | METH_KEYWORDS, "Stretch audio stream"},
+		{"stretch_async",(PyCFunction) stretch_async, METH_VARARGS | METH_KEYWORDS, "Stretch audio stream on a native worker, returning an asyncio future"},
+		{"shift",(PyCFunction) shift, METH_VARARGS | METH_KEYWORDS, "Shift the pitch of an audio stream by a number of semitones"},
+		{"stretch_file",(PyCFunction) stretch_file, METH_VARARGS | METH_KEYWORDS, "Stretch one sound file into another, without loading either into Python"},
+		{"stats",(PyCFunction) stats_, METH_VARARGS | METH_KEYWORDS, "Time spent in each stage of stretching, with sample, retrieve and allocation counts"},
+		{"pool_stats",(PyCFunction) pool_stats, METH_VARARGS | METH_KEYWORDS, "Capacity, idle count and hit / miss counters of the stretcher pool"},
+		{"set_pool_size",(PyCFunction) set_pool_size, METH_O, "Set the number of idle stretchers kept for reuse; 0 disables pooling"},
+		{"stretch_many",(PyCFunction) stretch_many, METH_VARARGS | METH_KEYWORDS, "Stretch a list of audio streams over a pool of native threads"},
 		{NULL, NULL, 0, NULL}
 };
 
@@ -90,6 +704,23 @@ PyMODINIT_FUNC PyInit_rubberband(void) {
 		auto result=PyModule_AddObject(m,ErrorName,rubberbandError);
 		if(result<0) throw std::runtime_error("Cannot attach RubberbandError to module");
 
+		completeFunction=PyCFunction_New(&CompleteDef,NULL);
+		if(completeFunction==NULL) throw std::runtime_error("Cannot create stretch_async completion");
+
+		StretcherType.tp_name="rubberband.Stretcher";
+		StretcherType.tp_doc="Streaming real-time audio stretcher";
+		StretcherType.tp_basicsize=sizeof(StretcherObject);
+		StretcherType.tp_itemsize=0;
+		StretcherType.tp_flags=Py_TPFLAGS_DEFAULT;
+		StretcherType.tp_new=Stretcher_new;
+		StretcherType.tp_init=(initproc) Stretcher_init;
+		StretcherType.tp_dealloc=(destructor) Stretcher_dealloc;
+		StretcherType.tp_methods=StretcherMethods;
+		StretcherType.tp_getset=StretcherGetSet;
+		if(PyType_Ready(&StretcherType)<0) throw std::runtime_error("Cannot initialise Stretcher type");
+		Py_INCREF(&StretcherType);
+		if(PyModule_AddObject(m,"Stretcher",(PyObject *)&StretcherType)<0) throw std::runtime_error("Cannot attach Stretcher to module");
+
 		for(auto it=PyTransformer::formatNames.begin();it!=PyTransformer::formatNames.end();it++) {
 			auto result=PyModule_AddIntConstant(m,it->second.c_str(),it->first);
 			if(result<0) throw std::runtime_error("Cannot attach type formats to module");
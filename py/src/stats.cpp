@@ -0,0 +1,123 @@
+/*
+ * stats.cpp
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include "stats.hpp"
+
+namespace stats {
+
+void Block::clear() {
+	for(unsigned i=0;i<NStages;i++) {
+		ns[i].store(0,std::memory_order_relaxed);
+		calls[i].store(0,std::memory_order_relaxed);
+	}
+	for(unsigned i=0;i<NCounters;i++) counters[i].store(0,std::memory_order_relaxed);
+}
+
+void Block::addTo(Totals &totals) const {
+	for(unsigned i=0;i<NStages;i++) {
+		totals.ns[i]+=ns[i].load(std::memory_order_relaxed);
+		totals.calls[i]+=calls[i].load(std::memory_order_relaxed);
+	}
+	for(unsigned i=0;i<NCounters;i++) totals.counters[i]+=counters[i].load(std::memory_order_relaxed);
+}
+
+// Blocks of threads that have finished are folded into the retired totals and
+// recycled, so short-lived worker threads don't accumulate blocks.
+
+class Registry {
+private:
+	std::mutex lock;
+	std::vector<std::unique_ptr<Block>> blocks;
+	std::vector<Block *> free;
+	Totals retired;
+	Totals baseline;
+
+	Totals sum() {
+		Totals totals=retired;
+		for(auto &block : blocks) block->addTo(totals);
+		return totals;
+	}
+
+public:
+	Registry() : blocks(), free() {
+		memset(&retired,0,sizeof(Totals));
+		memset(&baseline,0,sizeof(Totals));
+	}
+
+	Block * acquire() {
+		std::lock_guard<std::mutex> guard(lock);
+		if(!free.empty()) {
+			auto block=free.back();
+			free.pop_back();
+			return block;
+		}
+		blocks.emplace_back(new Block());
+		return blocks.back().get();
+	}
+	void release(Block *block) {
+		std::lock_guard<std::mutex> guard(lock);
+		block->addTo(retired);
+		block->clear();
+		free.push_back(block);
+	}
+	Totals read() {
+		std::lock_guard<std::mutex> guard(lock);
+		auto totals=sum();
+		for(unsigned i=0;i<NStages;i++) {
+			totals.ns[i]-=baseline.ns[i];
+			totals.calls[i]-=baseline.calls[i];
+		}
+		for(unsigned i=0;i<NCounters;i++) totals.counters[i]-=baseline.counters[i];
+		return totals;
+	}
+	void reset() {
+		std::lock_guard<std::mutex> guard(lock);
+		baseline=sum();
+	}
+};
+
+// Never destroyed, as threads can still be exiting after static destruction
+
+static Registry & registry() {
+	static Registry *r = new Registry();
+	return *r;
+}
+
+class Slot {
+public:
+	Block *block;
+	Slot() : block(registry().acquire()) {};
+	~Slot() { registry().release(block); }
+};
+
+Block & local() {
+	thread_local Slot slot;
+	return *slot.block;
+}
+
+Totals read() {
+	return registry().read();
+}
+
+void reset() {
+	registry().reset();
+}
+
+const char *name(const Stage stage) {
+	static const char *names[] = { "unpack", "study", "process", "drain", "pack" };
+	return names[(unsigned)stage];
+}
+
+const char *name(const Counter counter) {
+	static const char *names[] = { "samples_in", "samples_out", "retrieves", "allocated_bytes" };
+	return names[(unsigned)counter];
+}
+
+}
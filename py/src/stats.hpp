@@ -0,0 +1,94 @@
+/*
+ * stats.hpp
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef SRC_STATS_HPP_
+#define SRC_STATS_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Always-on instrumentation: time spent in each stage of a stretch, plus
+// sample, retrieve and allocation counts.  Each thread adds to its own block
+// of counters with plain relaxed stores, so recording costs a clock read and
+// no contention; readers sum every thread's block under a lock.  Resetting
+// takes a baseline rather than clearing the blocks, so writers never race it.
+
+namespace stats {
+
+enum class Stage : unsigned {
+	Unpack = 0,
+	Study,
+	Process,
+	Drain,
+	Pack,
+	Count
+};
+
+enum class Counter : unsigned {
+	SamplesIn = 0,
+	SamplesOut,
+	Retrieves,
+	AllocatedBytes,
+	Count
+};
+
+static const unsigned NStages = (unsigned)Stage::Count;
+static const unsigned NCounters = (unsigned)Counter::Count;
+
+struct Totals {
+	uint64_t ns[NStages];
+	uint64_t calls[NStages];
+	uint64_t counters[NCounters];
+};
+
+struct Block {
+	std::atomic<uint64_t> ns[NStages];
+	std::atomic<uint64_t> calls[NStages];
+	std::atomic<uint64_t> counters[NCounters];
+
+	Block() { clear(); }
+	void clear();
+	void addTo(Totals &totals) const;
+};
+
+Block & local();
+
+inline void bump(std::atomic<uint64_t> &value,const uint64_t n) {
+	value.store(value.load(std::memory_order_relaxed)+n,std::memory_order_relaxed);
+}
+
+inline void add(const Counter counter,const uint64_t n) {
+	bump(local().counters[(unsigned)counter],n);
+}
+
+class Timer {
+private:
+	Stage stage;
+	std::chrono::steady_clock::time_point start;
+
+public:
+	Timer(const Stage stage_) : stage(stage_), start(std::chrono::steady_clock::now()) {};
+	~Timer() {
+		auto elapsed=std::chrono::steady_clock::now()-start;
+		auto &block=local();
+		bump(block.ns[(unsigned)stage],std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+		bump(block.calls[(unsigned)stage],1);
+	}
+	Timer(const Timer &) = delete;
+	Timer & operator=(const Timer &) = delete;
+};
+
+Totals read();
+void reset();
+const char *name(const Stage stage);
+const char *name(const Counter counter);
+
+}
+
+
+
+#endif /* SRC_STATS_HPP_ */
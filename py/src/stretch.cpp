@@ -11,38 +11,131 @@
 #include <thread>
 #include <algorithm>
 #include <map>
-//#include "Debug.hpp"
+#include <string>
+#include <cmath>
+#include <stdexcept>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "./stretch.hpp"
+#include "./stats.hpp"
+#include "./workers.hpp"
 
 static const unsigned ibs=1024;
+const unsigned Stretch::BlockSize=ibs;
+
+// Stereo is split and merged four frames at a time with SSE2 shuffles, used
+// without dispatch as the PCM kernels are (see pcm.hpp).  Wider layouts walk
+// the interleaved side frame by frame so it is read or written in order.
+
+static void deinterleave(const float *data,const unsigned channels,const unsigned long frames,float * const *outs) {
+	if(channels==1) {
+		std::copy(data,data+frames,outs[0]);
+		return;
+	}
+	unsigned long i=0;
+	if(channels==2) {
+		auto l=outs[0], r=outs[1];
+#ifdef __SSE2__
+		for(;i+4<=frames;i+=4) {
+			auto a=_mm_loadu_ps(data+2*i);
+			auto b=_mm_loadu_ps(data+2*i+4);
+			_mm_storeu_ps(l+i,_mm_shuffle_ps(a,b,_MM_SHUFFLE(2,0,2,0)));
+			_mm_storeu_ps(r+i,_mm_shuffle_ps(a,b,_MM_SHUFFLE(3,1,3,1)));
+		}
+#endif
+		for(;i<frames;i++) {
+			l[i]=data[2*i];
+			r[i]=data[2*i+1];
+		}
+		return;
+	}
+	for(;i<frames;i++) {
+		auto d=data+i*channels;
+		for(unsigned c=0;c<channels;c++) outs[c][i]=d[c];
+	}
+}
+
+static void interleave(const float * const *ins,const unsigned channels,const unsigned long frames,float *data) {
+	if(channels==1) {
+		std::copy(ins[0],ins[0]+frames,data);
+		return;
+	}
+	unsigned long i=0;
+	if(channels==2) {
+		auto l=ins[0], r=ins[1];
+#ifdef __SSE2__
+		for(;i+4<=frames;i+=4) {
+			auto a=_mm_loadu_ps(l+i);
+			auto b=_mm_loadu_ps(r+i);
+			_mm_storeu_ps(data+2*i,_mm_unpacklo_ps(a,b));
+			_mm_storeu_ps(data+2*i+4,_mm_unpackhi_ps(a,b));
+		}
+#endif
+		for(;i<frames;i++) {
+			data[2*i]=l[i];
+			data[2*i+1]=r[i];
+		}
+		return;
+	}
+	for(;i<frames;i++) {
+		auto d=data+i*channels;
+		for(unsigned c=0;c<channels;c++) d[c]=ins[c][i];
+	}
+}
+
+// A view onto interleaved input, presented one block at a time as per-channel
+// pointers.  Mono blocks point straight into the input; multichannel blocks are
+// deinterleaved into scratch buffers.
 
 class StretchBuffer {
 public:
-	std::vector<float> buffer;
+	const float *data;
+	unsigned channels;
 	unsigned long  chunk;
 	long offset;
 	unsigned long n;
 	unsigned long remaining;
 
+	std::vector<std::vector<float>> blocks;
+	std::vector<float *> scratch;
+	std::vector<const float *> pointers;
+
 
 public:
-	StretchBuffer(const std::vector<float> &b_,const unsigned c_ = 1024) : buffer(b_), chunk(c_), offset(-chunk), n(buffer.size()), remaining(n) {};
+	StretchBuffer(const float *d_,const unsigned long n_,const unsigned ch_=1,const unsigned c_ = 1024) : data(d_), channels(ch_),
+		chunk(c_), offset(-chunk), n(n_), remaining(n),
+		blocks(channels>1 ? channels : 0,std::vector<float>(chunk,0.0)), scratch(blocks.size()), pointers(channels) {
+		std::transform(blocks.begin(),blocks.end(),scratch.begin(),[](std::vector<float> &b) { return b.data(); });
+		std::copy(scratch.begin(),scratch.end(),pointers.begin());
+	};
 	virtual ~StretchBuffer() = default;
 
 	void reset() {
 		offset=0;
 		remaining=n;
 	}
+	// The first step is always taken, even over empty input, so the stretcher
+	// is always given a final block and available() eventually returns -1.
 	bool step() {
 		offset+=chunk;
 		remaining=n-offset;
-		return offset<n;
+		return offset<(long)n || offset==0;
 	}
 
 
-	unsigned long size() const { return std::min<unsigned>(chunk,remaining); }
-	float * operator *() { return buffer.data()+offset; }
+	unsigned long size() const { return std::min<unsigned long>(chunk,remaining); }
+	const float * const * operator *() {
+		if(channels==1) {
+			pointers[0]=data+offset;
+		}
+		else {
+			deinterleave(data+offset*channels,channels,size(),scratch.data());
+		}
+		return pointers.data();
+	}
 	operator bool() const { return chunk >= remaining; }
 
 };
@@ -68,88 +161,388 @@ public:
 		return option;
 	}
 
-Stretch::Stretch(const unsigned frames,const unsigned channels,const int samplerate,const double ratio,const RB::Options opts) :
-		nFramesIn(frames), nChannels(channels), sampleRate(samplerate),
-		in(nChannels*nFramesIn,0.0), out(),
-		stretcher(sampleRate,nChannels,opts,ratio,1.0), buffer() {}
-Stretch::Stretch(const SF_INFO &info,const double ratio,const RB::Options opts) :
-		Stretch(info.frames,info.channels,info.samplerate,ratio,opts) {}
+static double positive(const double value,const char *what) {
+	if(value<=0.0) throw std::invalid_argument(std::string(what) + " must be positive");
+	return value;
+}
+
+Stretch::Stretch(const unsigned frames,const unsigned channels,const int samplerate,const double ratio,const RB::Options opts,const double pitch) :
+		nFramesIn(frames), nChannels(channels), sampleRate(samplerate), options(opts),
+		requestedBlock(ibs), block(ibs),
+		threaded(!(opts & RB::OptionThreadingNever)), keyFrames(), out(),
+		stretcher(StretcherPool::shared().acquire(sampleRate,nChannels,options,positive(ratio,"Ratio"),positive(pitch,"Pitch scale"))),
+		buffer(nChannels), pointers(nChannels) {}
+Stretch::Stretch(const SF_INFO &info,const double ratio,const RB::Options opts,const double pitch) :
+		Stretch(info.frames,info.channels,info.samplerate,ratio,opts,pitch) {}
+Stretch::~Stretch() {
+	StretcherPool::shared().release(sampleRate,nChannels,options,std::move(stretcher));
+}
+
+// Key frames map input frames to the output frames they must land on, with
+// the stretch varying between them.  Both sides must increase together.
+
+void Stretch::setKeyFrames(const KeyFrames &frames) {
+	size_t lastOut=0;
+	for(auto it=frames.begin();it!=frames.end();it++) {
+		if(it!=frames.begin() && it->second<=lastOut) throw std::invalid_argument("Key frames must increase in both input and output");
+		lastOut=it->second;
+	}
+	keyFrames=frames;
+}
+
+// The number of frames fed to each study / process call.  AutoBlockSize picks
+// one when stretching starts, from what the stretcher asks for and the cache.
 
-std::vector<double> Stretch::operator()(const std::vector<double> &input) {
-	std::vector<float> i(input.size(),0);
-	std::transform(input.begin(),input.end(),i.begin(),[](double x) { return (float)x; });
+void Stretch::setBlockSize(const unsigned size) {
+	requestedBlock=size;
+	block=(size==AutoBlockSize) ? ibs : size;
+}
+
+static unsigned long cacheBytes() {
+#ifdef _SC_LEVEL2_CACHE_SIZE
+	auto size=sysconf(_SC_LEVEL2_CACHE_SIZE);
+	if(size>0) return size;
+#endif
+	return 256*1024;
+}
 
-	(*this)(i);
-	std::vector<double> o(out.size(),0);
-	std::transform(out.begin(),out.end(),o.begin(),[](float x) { return (double)x; });
-	return o;
+// Large blocks mean fewer library calls, but a block is held about four times
+// over (interleaved input, deinterleaved channels, retrieved channels and
+// interleaved output), and all of that should fit in L2.  The block is never
+// smaller than the stretcher's own request for its next output.
+
+unsigned Stretch::autoBlockSize() const {
+	unsigned long fits=cacheBytes()/(4*sizeof(float)*nChannels);
+	unsigned size=1024;
+	while(size<16384 && 2*size<=fits) size*=2;
+	auto required=stretcher->getSamplesRequired();
+	while(size<required) size*=2;
+	return size;
 }
+
 std::vector<float> Stretch::operator()(const std::vector<float> &input) {
-	in.assign(input.begin(),input.end());
+	return (*this)(input.data(),input.size()/nChannels);
+}
+std::vector<float> Stretch::operator()(const float *input,const unsigned long frames) {
+	nFramesIn=frames;
+	if(requestedBlock==AutoBlockSize) block=autoBlockSize();
 	countOut=0;
-	out.clear();
-
-	study();
+	out.assign(expectedFramesOut()*nChannels,0.0);
+	stats::add(stats::Counter::AllocatedBytes,out.size()*sizeof(float));
 
-	in.assign(input.begin(),input.end());
-	process();
+	study(input);
+	process(input);
+	out.resize(countOut*nChannels);
 
 	std::transform(out.begin(),out.end(),out.begin(),[](const float x) {
 		return std::min(1.0f,std::max(-1.0f,x));
 	});
-	return out;
+	return std::move(out);
 }
 
 
 
-void Stretch::study() {
-	//debug::Debug::debug << "Studying "  << in.size() << " samples "; debug::Debug::debug.eol();
+unsigned long Stretch::expectedFramesOut() const {
+	return (unsigned long)std::ceil(nFramesIn*stretcher->getTimeRatio())+stretcher->getLatency()+block;
+}
 
-	stretcher.setExpectedInputDuration(in.size());
-	StretchBuffer buffer(in,ibs);
+void Stretch::study(const float *input) {
+	stats::Timer timer(stats::Stage::Study);
+	stretcher->setExpectedInputDuration(nFramesIn);
+	StretchBuffer buffer(input,nFramesIn,nChannels,block);
 	while(buffer.step()) {
-		//debug::Debug::debug.outputLevel(debug::Level::High);
-		//debug::Debug::debug << "  " << buffer.size() << " samples at offset " << buffer.offset << " (final: " << (bool)buffer << ")";  debug::Debug::debug.eol();
-		auto ibuf=*buffer;
-		stretcher.study(&ibuf,buffer.size(),buffer);
+		stretcher->study(*buffer,buffer.size(),buffer);
 	}
-
-
 }
 
-void Stretch::process() {
-
-	//debug::Debug::debug << "Processing " << in.size() << " samples "; debug::Debug::debug.eol();
-	StretchBuffer buffer(in,ibs);
-	while(buffer.step()) {
-		auto ibuf=*buffer;
-		stretcher.process(&ibuf,buffer.size(),buffer);
-		int available=stretcher.available();
-		if(available>0) processAvailable(available);
+void Stretch::process(const float *input) {
+	{
+		stats::Timer timer(stats::Stage::Process);
+		stretcher->setKeyFrameMap(keyFrames);
+		StretchBuffer buffer(input,nFramesIn,nChannels,block);
+		while(buffer.step()) {
+			stretcher->process(*buffer,buffer.size(),buffer);
+			int available=stretcher->available();
+			if(available>0) processAvailable(available);
+		}
+		stats::add(stats::Counter::SamplesIn,(uint64_t)nFramesIn*nChannels);
 	}
+	drain();
+}
 
-	int available=stretcher.available();
+void Stretch::drain() {
+	// Without worker threads, available() does the outstanding processing itself,
+	// so the tail can be drained back-to-back until it reports -1.  Only a
+	// threaded stretcher needs to be given time to catch up.
+	stats::Timer timer(stats::Stage::Drain);
+	int available=stretcher->available();
 	while (available>= 0) {
 		if (available > 0) {
 			processAvailable(available);
-		} else {
-			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		} else if (threaded) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
 		}
-		available=stretcher.available();
+		available=stretcher->available();
 	}
+}
 
-	//debug::Debug::debug << "Processing completed"; debug::Debug::debug.eol();
+// One pass over a source, in blocks: studying it, or processing it and handing
+// each retrieved block to the sink.  A short read marks the end of the input.
+
+void Stretch::pass(StretchSource &source,const bool studying) {
+	stats::Timer timer(studying ? stats::Stage::Study : stats::Stage::Process);
+	std::vector<float> data(block*nChannels);
+	std::vector<std::vector<float>> planes(nChannels,std::vector<float>(block));
+	std::vector<float *> scratch(nChannels);
+	std::vector<const float *> channels(nChannels);
+	for(unsigned c=0;c<nChannels;c++) channels[c]=scratch[c]=planes[c].data();
+
+	source.rewind();
+	unsigned long offset=0;
+	bool final=false;
+	while(!final) {
+		auto wanted=std::min<unsigned long>(block,nFramesIn-offset);
+		auto n=source.read(data.data(),wanted);
+		final = n<wanted || offset+n>=nFramesIn;
+		deinterleave(data.data(),nChannels,n,scratch.data());
+		if(studying) {
+			stretcher->study(channels.data(),n,final);
+		}
+		else {
+			stretcher->process(channels.data(),n,final);
+			int available=stretcher->available();
+			if(available>0) processAvailable(available);
+			stats::add(stats::Counter::SamplesIn,n*nChannels);
+		}
+		offset+=n;
+	}
+}
+
+unsigned long Stretch::operator()(StretchSource &source,const StretchSink &output) {
+	countOut=0;
+	sink=&output;
+	if(requestedBlock==AutoBlockSize) block=autoBlockSize();
+	stretcher->setExpectedInputDuration(nFramesIn);
+	try {
+		pass(source,true);
+		stretcher->setKeyFrameMap(keyFrames);
+		pass(source,false);
+		drain();
+	}
+	catch(...) {
+		sink=nullptr;
+		throw;
+	}
+	sink=nullptr;
+	return countOut;
+}
+
+// The input frame at or a little before start whose position in the output is
+// closest to a whole frame, so that segments line up to within a fraction of a
+// sample where they are crossfaded.
+
+static unsigned long alignedStart(const unsigned long start,const double ratio) {
+	auto best=start;
+	auto error=1.0;
+	for(unsigned long f=start;f+256>start && f>0;f--) {
+		auto e=std::abs(f*ratio-std::round(f*ratio));
+		if(e<error) {
+			best=f;
+			error=e;
+		}
+		if(e<1.0e-6) break;
+	}
+	return best;
+}
+
+// Stretches the input as overlapping segments, one Stretch per segment, over
+// up to nWorkers threads.  Segment k owns input [b(k), b(k+1)) and output
+// [B(k), B(k+1)) with B(k) = round(b(k) * ratio), so the result is exactly
+// round(frames * ratio) frames long.  Each segment also stretches a pre-roll
+// either side of its share, so the stretcher has settled by the time its output
+// is used, and neighbours are joined with an equal-power crossfade centred on
+// B(k).  Inputs too short to split, and key-framed stretches, run serially.
+
+std::vector<float> Stretch::parallel(const float *input,const unsigned long frames,const unsigned nWorkers) {
+	auto ratio=stretcher->getTimeRatio();
+	auto pitch=stretcher->getPitchScale();
+	unsigned long preRoll=std::max<unsigned long>(stretcher->getLatency(),sampleRate/10);
+	unsigned long half=std::max<unsigned long>(32,sampleRate/40);
+	unsigned long fade=2*half;
+	unsigned long fadeIn=(unsigned long)std::ceil(fade/ratio);
+	unsigned long minimum=std::max<unsigned long>(sampleRate,4*(preRoll+fadeIn));
+
+	unsigned long n=std::min<unsigned long>(nWorkers,frames/minimum);
+	if(n<=1 || !keyFrames.empty()) return (*this)(input,frames);
+
+	std::vector<unsigned long> b(n+1), B(n+1);
+	for(unsigned long k=0;k<=n;k++) {
+		b[k]=(k*frames)/n;
+		B[k]=(unsigned long)std::llround(b[k]*ratio);
+	}
+	auto total=B[n];
+
+	std::vector<std::vector<float>> outs(n);
+	std::vector<unsigned long> starts(n);
+	std::vector<std::string> errors(n);
+	workers::parallel(n,nWorkers,[&](const unsigned long k) {
+		try {
+			auto from=(k==0) ? 0 : alignedStart(b[k]-std::min(b[k],preRoll+fadeIn),ratio);
+			auto to=(k==n-1) ? frames : std::min(frames,b[k+1]+preRoll+fadeIn);
+			starts[k]=(unsigned long)std::llround(from*ratio);
+			Stretch segment(to-from,nChannels,sampleRate,ratio,options,pitch);
+			segment.setBlockSize(requestedBlock);
+			outs[k]=segment(input+from*nChannels,to-from);
+		}
+		catch(std::exception &e) {
+			errors[k]=e.what();
+		}
+	});
+	for(auto &e : errors) if(!e.empty()) throw std::runtime_error(e);
+
+	std::vector<float> result(total*nChannels,0.0f);
+	auto sample=[&](const unsigned long k,const unsigned long o,const unsigned c) {
+		auto j=o-starts[k];
+		if(o<starts[k] || j>=outs[k].size()/nChannels) return 0.0f;
+		return outs[k][j*nChannels+c];
+	};
+	for(unsigned long k=0;k<n;k++) {
+		auto from=(k==0) ? 0 : B[k]+half;
+		auto to=(k==n-1) ? total : B[k+1]-half;
+		for(auto o=from;o<to;o++) {
+			for(unsigned c=0;c<nChannels;c++) result[o*nChannels+c]=sample(k,o,c);
+		}
+	}
+
+	// Neighbouring segments are stretched from the same audio, so are largely
+	// coherent across the join.  Plain sin / cos gains would then bulge by up to
+	// 3dB, so they are normalised by the measured correlation to keep the power
+	// of the mix constant.
+	for(unsigned long k=1;k<n;k++) {
+		auto from=B[k]-half;
+		double cross=0, early=0, late=0;
+		for(auto o=from;o<B[k]+half;o++) {
+			for(unsigned c=0;c<nChannels;c++) {
+				double x=sample(k-1,o,c), y=sample(k,o,c);
+				cross+=x*y;
+				early+=x*x;
+				late+=y*y;
+			}
+		}
+		auto rho=(early>0 && late>0) ? std::max(0.0,std::min(1.0,cross/std::sqrt(early*late))) : 0.0;
+		for(auto o=from;o<B[k]+half;o++) {
+			auto theta=M_PI_2*(o-from+0.5)/fade;
+			auto norm=1.0/std::sqrt(1.0+rho*std::sin(2*theta));
+			auto out=std::cos(theta)*norm, in=std::sin(theta)*norm;
+			for(unsigned c=0;c<nChannels;c++) result[o*nChannels+c]=out*sample(k-1,o,c)+in*sample(k,o,c);
+		}
+	}
+	std::transform(result.begin(),result.end(),result.begin(),[](const float x) {
+		return std::min(1.0f,std::max(-1.0f,x));
+	});
+	return result;
 }
 
 void Stretch::processAvailable(const int available) {
-	//debug::Debug::debug.outputLevel(debug::Level::High);
-	//debug::Debug::debug << "Retrieving " << available; debug::Debug::debug.eol();
+	stats::add(stats::Counter::Retrieves,1);
+	size_t retrieved;
+	if(sink!=nullptr) {
+		for(unsigned c=0;c<nChannels;c++) {
+			if(buffer[c].size()<(unsigned)available) buffer[c].resize(available);
+			pointers[c]=buffer[c].data();
+		}
+		retrieved=stretcher->retrieve(pointers.data(), available);
+		if(out.size()<retrieved*nChannels) out.resize(retrieved*nChannels);
+		interleave(pointers.data(),nChannels,retrieved,out.data());
+		std::transform(out.begin(),out.begin()+retrieved*nChannels,out.begin(),[](const float x) {
+			return std::min(1.0f,std::max(-1.0f,x));
+		});
+		(*sink)(out.data(),retrieved);
+		countOut += retrieved;
+		stats::add(stats::Counter::SamplesOut,retrieved*nChannels);
+		return;
+	}
 
-	buffer.assign(available,0);
-	auto p=buffer.data();
-	stretcher.retrieve(&p, available);
-	countOut += available;
-	out.insert(out.end(),buffer.begin(),buffer.end());
+	auto needed=(countOut+available)*nChannels;
+	if(out.size()<needed) {
+		auto size=std::max<unsigned long>(needed,2*out.size());
+		stats::add(stats::Counter::AllocatedBytes,(size-out.size())*sizeof(float));
+		out.resize(size);
+	}
+
+	if(nChannels==1) {
+		auto p=out.data()+countOut;
+		retrieved=stretcher->retrieve(&p, available);
+	}
+	else {
+		for(unsigned c=0;c<nChannels;c++) {
+			if(buffer[c].size()<(unsigned)available) buffer[c].resize(available);
+			pointers[c]=buffer[c].data();
+		}
+		retrieved=stretcher->retrieve(pointers.data(), available);
+		interleave(pointers.data(),nChannels,retrieved,out.data()+countOut*nChannels);
+	}
+	countOut += retrieved;
+	stats::add(stats::Counter::SamplesOut,retrieved*nChannels);
+}
+
+
+StretchStream::StretchStream(const unsigned channels,const int samplerate,const double ratio,const RB::Options opts) :
+		nChannels(channels), stretcher(samplerate,nChannels,opts | RB::OptionProcessRealTime,positive(ratio,"Ratio"),1.0),
+		buffer(nChannels,std::vector<float>(ibs,0.0)), pointers(nChannels) {
+	stretcher.setMaxProcessSize(ibs);
+}
+
+void StretchStream::feed(const float *data,const unsigned long frames,const bool final) {
+	stats::Timer timer(stats::Stage::Process);
+	stats::add(stats::Counter::SamplesIn,frames*nChannels);
+	for(unsigned c=0;c<nChannels;c++) pointers[c]=buffer[c].data();
+	unsigned long offset=0;
+	do {
+		auto n=std::min<unsigned long>(ibs,frames-offset);
+		deinterleave(data+offset*nChannels,nChannels,n,pointers.data());
+		offset+=n;
+		stretcher.process(pointers.data(),n,final && offset>=frames);
+	} while(offset<frames);
+}
+
+void StretchStream::push(const float *data,const unsigned long frames) {
+	if(frames>0) feed(data,frames,false);
+}
+
+std::vector<float> StretchStream::pull() {
+	std::vector<float> out;
+	int n=stretcher.available();
+	while(n>0) {
+		for(unsigned c=0;c<nChannels;c++) {
+			buffer[c].resize(std::max<size_t>(buffer[c].size(),n));
+			pointers[c]=buffer[c].data();
+		}
+		auto got=stretcher.retrieve(pointers.data(),n);
+		stats::add(stats::Counter::Retrieves,1);
+		stats::add(stats::Counter::SamplesOut,got*nChannels);
+		auto offset=out.size();
+		out.resize(offset+got*nChannels);
+		interleave(pointers.data(),nChannels,got,out.data()+offset);
+		n=stretcher.available();
+	}
+	std::transform(out.begin(),out.end(),out.begin(),[](const float x) {
+		return std::min(1.0f,std::max(-1.0f,x));
+	});
+	return out;
+}
+
+std::vector<float> StretchStream::flush() {
+	feed(nullptr,0,true);
+	auto out=pull();
+	stretcher.reset();
+	return out;
 }
 
+int StretchStream::available() const {
+	return std::max(0,stretcher.available());
+}
 
+unsigned StretchStream::latency() const {
+	return stretcher.getLatency();
+}
@@ -9,8 +9,11 @@
 #define STRETCH_HPP_
 
 #include <vector>
+#include <map>
+#include <functional>
 #include <sndfile.h>
 #include <rubberband/RubberBandStretcher.h>
+#include "pool.hpp"
 
 using namespace RubberBand;
 using RB = RubberBandStretcher;
@@ -18,6 +21,19 @@ using RB = RubberBandStretcher;
 
 
 
+// Interleaved audio read a block at a time, for stretching without holding the
+// whole input in memory.  It is read twice, once to study and once to process,
+// so must be able to rewind.
+
+class StretchSource {
+public:
+	virtual ~StretchSource() = default;
+	virtual unsigned long read(float *data,const unsigned long frames) = 0;
+	virtual void rewind() = 0;
+};
+
+using StretchSink = std::function<void(const float *,const unsigned long)>;
+
 class Stretch {
 private:
 
@@ -26,33 +42,76 @@ private:
 	unsigned nFramesIn;
 	unsigned nChannels;
 	int sampleRate;
+	RB::Options options;
+	unsigned requestedBlock;
+	unsigned block;
+	bool threaded;
+	std::map<size_t,size_t> keyFrames;
 
-	std::vector<float> in;
 	std::vector<float> out;
+	const StretchSink *sink=nullptr;
 
-	RB stretcher;
+	StretcherPool::Handle stretcher;
 
 
 
-	std::vector<float>::iterator it;
-	std::vector<float> buffer;
+	std::vector<std::vector<float>> buffer;
+	std::vector<float *> pointers;
 
+	unsigned long expectedFramesOut() const;
 	void processAvailable(const int available);
 
-	void study();
-	void process();
+	void study(const float *input);
+	void process(const float *input);
+	void drain();
+	void pass(StretchSource &source,const bool studying);
+	unsigned autoBlockSize() const;
 
 public:
 
 	using Options = RB::Options;
+	using KeyFrames = std::map<size_t,size_t>;
+	static const unsigned BlockSize;
+	static const unsigned AutoBlockSize = 0;
 	static Options makeOptions(const int crispness=5,const bool formant=false,const bool precise=true);
 
-	Stretch(const unsigned frames,const unsigned channels,const int samplerate,const double ratio,const RB::Options opts = 0);
-	Stretch(const SF_INFO &info,const double ratio,const RB::Options opts = 0);
-	virtual ~Stretch() = default;
+	Stretch(const unsigned frames,const unsigned channels,const int samplerate,const double ratio,const RB::Options opts = 0,const double pitch = 1.0);
+	Stretch(const SF_INFO &info,const double ratio,const RB::Options opts = 0,const double pitch = 1.0);
+	virtual ~Stretch();
+
+	void setKeyFrames(const KeyFrames &frames);
+	void setBlockSize(const unsigned size);
+	unsigned blockSize() const { return block; }
 
+	std::vector<float> operator()(const float *input,const unsigned long frames);
 	std::vector<float> operator()(const std::vector<float> &input);
-	std::vector<double> operator()(const std::vector<double> &input);
+	unsigned long operator()(StretchSource &source,const StretchSink &output);
+	std::vector<float> parallel(const float *input,const unsigned long frames,const unsigned nWorkers);
+};
+
+class StretchStream {
+private:
+
+	unsigned nChannels;
+	RB stretcher;
+
+	std::vector<std::vector<float>> buffer;
+	std::vector<float *> pointers;
+
+	void feed(const float *data,const unsigned long frames,const bool final);
+
+public:
+
+	StretchStream(const unsigned channels,const int samplerate,const double ratio,const RB::Options opts = 0);
+	virtual ~StretchStream() = default;
+
+	void push(const float *data,const unsigned long frames);
+	std::vector<float> pull();
+	std::vector<float> flush();
+
+	int available() const;
+	unsigned latency() const;
+	unsigned channels() const { return nChannels; }
 };
 
 
@@ -0,0 +1,100 @@
+/*
+ * workers.hpp
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef SRC_WORKERS_HPP_
+#define SRC_WORKERS_HPP_
+
+#include <thread>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+namespace workers {
+
+inline unsigned defaultCount() {
+	return std::max(1u,std::thread::hardware_concurrency());
+}
+
+// Runs job(0) ... job(n-1) over a pool of up to nWorkers threads, each
+// taking the next unclaimed index, and returns once every job is done.
+// Jobs are expected to handle their own exceptions.
+
+template<typename F>
+void parallel(const unsigned long n,const unsigned nWorkers,F &&job) {
+	std::atomic<unsigned long> next(0);
+	auto worker = [&next,n,&job]() {
+		for(auto i=next++;i<n;i=next++) job(i);
+	};
+
+	auto count=std::min<unsigned long>(std::max(1u,nWorkers),n);
+	if(count<=1) {
+		worker();
+		return;
+	}
+	std::vector<std::thread> threads;
+	for(unsigned long t=1;t<count;t++) threads.emplace_back(worker);
+	worker();
+	for(auto &t : threads) t.join();
+}
+
+// A fixed set of long-lived threads running jobs in the order they are
+// submitted.  submit() returns at once; jobs report their own results.
+
+class Queue {
+private:
+	std::mutex lock;
+	std::condition_variable ready;
+	std::deque<std::function<void()>> jobs;
+	std::vector<std::thread> threads;
+	bool stopping=false;
+
+	void run() {
+		while(true) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				ready.wait(guard,[this]() { return stopping || !jobs.empty(); });
+				if(jobs.empty()) return;
+				job=std::move(jobs.front());
+				jobs.pop_front();
+			}
+			job();
+		}
+	}
+
+public:
+	Queue(const unsigned nWorkers=defaultCount()) {
+		for(unsigned t=0;t<std::max(1u,nWorkers);t++) threads.emplace_back([this]() { run(); });
+	}
+	virtual ~Queue() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping=true;
+		}
+		ready.notify_all();
+		for(auto &t : threads) t.join();
+	}
+	Queue(const Queue &) = delete;
+	Queue & operator=(const Queue &) = delete;
+
+	void submit(std::function<void()> &&job) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			jobs.push_back(std::move(job));
+		}
+		ready.notify_one();
+	}
+};
+
+}
+
+
+
+#endif /* SRC_WORKERS_HPP_ */
@@ -0,0 +1,37 @@
+#!/usr/bin/env python3
+'''
+Created on 17 Oct 2026
+'''
+import rubberband
+import numpy
+
+data = numpy.sin(numpy.arange(48000,dtype=numpy.float32)*0.05)
+
+def rejects(**kwargs):
+    try:
+        rubberband.stretch(data,rate=48000,**kwargs)
+    except ValueError:
+        return
+    raise AssertionError(f'{kwargs} was accepted')
+
+# Key frames may be given as any pairs: tuples, lists, array rows or a dict
+pairs = [(0,0), (24000,36000), (48000,60000)]
+for keyframes in [pairs, [list(p) for p in pairs], numpy.array(pairs), dict(pairs)]:
+    out = rubberband.stretch(data,rate=48000,ratio=1.25,keyframes=keyframes)
+    assert len(out)>0
+rejects(keyframes=[(0,0,0)])
+rejects(keyframes=[(-1,0)])
+rejects(keyframes=[(0,10), (10,5)])
+rejects(keyframes=5)
+
+# Block sizes are positive frame counts, or "auto"
+for block in [256, 'auto']:
+    assert len(rubberband.stretch(data,rate=48000,ratio=1.5,block_size=block))>0
+for block in [0, -1, 1<<21, 'big', 1.5]:
+    rejects(block_size=block)
+
+# Scalar arguments are checked before the input is converted
+for kwargs in [dict(parallel=0), dict(parallel=-2), dict(ratio=0), dict(ratio=-1.0), dict(pitch=0)]:
+    rejects(**kwargs)
+
+print('Arguments OK')
@@ -0,0 +1,42 @@
+#!/usr/bin/env python3
+'''
+Created on 17 Oct 2026
+'''
+import rubberband
+import soundfile
+import numpy
+import asyncio
+import time
+from sys import argv
+
+requests = 8 if len(argv)<2 else int(argv[1])
+
+data, rate = soundfile.read('slugs.wav',dtype='int16')
+stream = numpy.tile(data,8)
+ratio = 1.5
+
+async def ticker(stop):
+    '''Counts how often the loop gets round to it, and the longest it was kept waiting'''
+    ticks, worst = 0, 0.0
+    while not stop.is_set():
+        start = time.perf_counter()
+        await asyncio.sleep(0.001)
+        worst = max(worst,time.perf_counter()-start)
+        ticks += 1
+    return ticks, worst
+
+async def main():
+    stop = asyncio.Event()
+    tick = asyncio.create_task(ticker(stop))
+    start = time.perf_counter()
+    results = await asyncio.gather(*[rubberband.stretch_async(stream,rate=rate,ratio=ratio) for _ in range(requests)])
+    elapsed = time.perf_counter()-start
+    stop.set()
+    ticks, worst = await tick
+
+    print(f'{requests} requests in {elapsed:.3f} s')
+    print(f'Event loop ran {ticks} times, longest wait {1000*worst:.1f} ms')
+    reference = rubberband.stretch(stream,rate=rate,ratio=ratio)
+    assert all(numpy.array_equal(r,reference) for r in results), 'Async results differ'
+
+asyncio.run(main())
@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+'''
+Created on 17 Oct 2026
+'''
+import rubberband
+import numpy
+import faulthandler
+
+# Empty input once left the stretcher waiting for a final block that never
+# came, so fail loudly rather than hang.
+faulthandler.dump_traceback_later(30,exit=True)
+
+for dtype, fmt in [(numpy.float32, rubberband.float32), (numpy.int16, rubberband.int16)]:
+    for channels in [1, 2]:
+        data = numpy.zeros((0,channels) if channels>1 else 0,dtype)
+        out = rubberband.stretch(data,format=fmt,rate=44100,ratio=1.5)
+        assert len(out)==0, f'Empty {dtype.__name__} x{channels} gave {len(out)} frames'
+        out = rubberband.stretch(data,format=fmt,rate=44100,ratio=1.5,precise=True,block_size='auto')
+        assert len(out)==0
+assert len(rubberband.stretch(b'',format=rubberband.int16,ratio=2.0))==0
+
+# An empty clip in a batch must come back empty without holding up the rest
+clip = numpy.sin(numpy.arange(44100,dtype=numpy.float32)*0.05)
+for ratios in [1.5, [1.5, 1.5, 0.75], numpy.array([1.5, 1.5, 0.75])]:
+    out = rubberband.stretch_many([clip, numpy.zeros(0,numpy.float32), clip],ratios=ratios,rate=44100,workers=2)
+    assert len(out[0])>0 and len(out[1])==0 and len(out[2])>0, [len(o) for o in out]
+for ratios in ['fast', [1.5], [1.5, 'x']]:
+    try:
+        rubberband.stretch_many([clip, clip],ratios=ratios)
+        assert False, f'ratios={ratios} was accepted'
+    except ValueError:
+        pass
+for workers in [0, -1]:
+    try:
+        rubberband.stretch_many([clip],workers=workers)
+        assert False, f'workers={workers} was accepted'
+    except ValueError:
+        pass
+
+faulthandler.cancel_dump_traceback_later()
+print('Empty input OK')
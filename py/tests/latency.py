@@ -0,0 +1,25 @@
+#!/usr/bin/env python3
+'''
+Created on 17 Oct 2026
+'''
+import rubberband
+import soundfile
+import time
+from sys import argv
+
+calls = 200 if len(argv)<2 else int(argv[1])
+
+data, rate = soundfile.read('slugs.wav',dtype='int16')
+
+for poolSize in [0, 16]:
+    rubberband.set_pool_size(poolSize)
+    print(f'Pool size {poolSize}')
+    for duration in [0.05, 0.1, 0.25, 0.5, 1.0]:
+        clip = data[:int(duration*rate)]
+        start = time.perf_counter()
+        for _ in range(calls):
+            rubberband.stretch(clip,rate=rate,ratio=1.25,crispness=5,formants=False,precise=True)
+        elapsed = time.perf_counter()-start
+        perCall = 1000*elapsed/calls
+        print(f'{duration:5.2f}s clip : {perCall:8.3f} ms/call, realtime factor {1000*duration/perCall:8.1f}')
+    print(rubberband.pool_stats(reset=True))
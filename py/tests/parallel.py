@@ -0,0 +1,44 @@
+#!/usr/bin/env python3
+'''
+Created on 17 Oct 2026
+'''
+import rubberband
+import soundfile
+import numpy
+import time
+from sys import argv
+
+segments = [2, 4, 8] if len(argv)<2 else [int(a) for a in argv[1:]]
+ratios = [0.75, 1.25, 1.5, 2.0]
+
+data, rate = soundfile.read('slugs_ref.wav',dtype='float32')
+
+def stft(x, size=1024, hop=256):
+    window = numpy.hanning(size)
+    frames = [x[i:i+size]*window for i in range(0,len(x)-size,hop)]
+    return numpy.abs(numpy.fft.rfft(frames,axis=1))
+
+def compare(serial, parallel):
+    '''Signal to difference ratio and log-spectral distance of parallel from serial'''
+    error = serial-parallel
+    snr = 10*numpy.log10(numpy.sum(serial**2)/max(numpy.sum(error**2),1e-30))
+    a, b = stft(serial), stft(parallel)
+    lsd = numpy.mean(numpy.sqrt(numpy.mean((20*numpy.log10((a+1e-9)/(b+1e-9)))**2,axis=1)))
+    return snr, lsd
+
+def timed(**kwargs):
+    start = time.perf_counter()
+    out = rubberband.stretch(data,rate=rate,crispness=5,precise=True,**kwargs)
+    return out, time.perf_counter()-start
+
+print(f'slugs_ref.wav: {len(data)} frames at {rate} Hz')
+for ratio in ratios:
+    serial, serialTime = timed(ratio=ratio)
+    for n in segments:
+        parallel, parallelTime = timed(ratio=ratio,parallel=n)
+        expected = int(round(len(data)*ratio))
+        assert len(parallel)==expected, f'Parallel output is {len(parallel)} frames, expected {expected}'
+        m = min(len(serial),len(parallel))
+        snr, lsd = compare(serial[:m],parallel[:m])
+        print(f'ratio {ratio:4.2f} x{n} : {len(serial)} / {len(parallel)} frames, SNR {snr:6.1f} dB, '
+              f'LSD {lsd:5.2f} dB, speedup {serialTime/parallelTime:5.2f}')
@@ -0,0 +1,98 @@
+/*
+ * pcm_check.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *
+ *  Checks the vectorised PCM kernels are bit-exact against the scalar reference,
+ *  and that formats narrower than a float mantissa survive a round trip
+ */
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cstring>
+#include <limits>
+#include "pcm.hpp"
+
+static std::mt19937 rng(1234);
+static int failures = 0;
+
+template<typename T>
+void checkDecode(const char *name,const size_t n) {
+	std::uniform_int_distribution<long long> dist(std::numeric_limits<T>::min(),std::numeric_limits<T>::max());
+	std::vector<T> in(n);
+	for(auto &x : in) x=(T)dist(rng);
+	if(n>1) {
+		in[0]=std::numeric_limits<T>::min();
+		in[1]=std::numeric_limits<T>::max();
+	}
+
+	std::vector<float> fast(n), slow(n);
+	pcm::decode(in.data(),n,fast.data());
+	pcm::reference::decode(in.data(),n,slow.data());
+	if(memcmp(fast.data(),slow.data(),n*sizeof(float))) {
+		std::cerr << "FAIL: decode " << name << " n=" << n << std::endl;
+		failures++;
+	}
+}
+
+template<typename T>
+void checkEncode(const char *name,const size_t n) {
+	std::uniform_real_distribution<float> dist(-1.5f,1.5f);
+	std::vector<float> in(n);
+	for(auto &x : in) x=dist(rng);
+	// full scale, clipping and exact rounding ties
+	float edges[] = { -1.0f, 1.0f, 0.0f, -0.0f, 2.0f, -2.0f, 0.5f/pcm::Traits<T>::scale, 1.5f/pcm::Traits<T>::scale,
+			-2.5f/pcm::Traits<T>::scale, 1.0f-1.0f/pcm::Traits<T>::scale };
+	for(size_t i=0;i<std::min(n,sizeof(edges)/sizeof(float));i++) in[i*n/10]=edges[i];
+
+	std::vector<T> fast(n), slow(n);
+	pcm::encode(in.data(),n,fast.data());
+	pcm::reference::encode(in.data(),n,slow.data());
+	if(memcmp(fast.data(),slow.data(),n*sizeof(T))) {
+		std::cerr << "FAIL: encode " << name << " n=" << n << std::endl;
+		failures++;
+	}
+}
+
+template<typename T>
+void checkRoundTrip(const char *name,const long long lo,const long long hi) {
+	using tr = pcm::Traits<T>;
+	std::vector<T> in;
+	for(auto v=lo;v<=hi;v++) in.push_back(tr::make(v));
+	std::vector<float> samples(in.size());
+	std::vector<T> out(in.size());
+	pcm::decode(in.data(),in.size(),samples.data());
+	pcm::encode(samples.data(),samples.size(),out.data());
+	if(memcmp(in.data(),out.data(),in.size()*sizeof(T))) {
+		std::cerr << "FAIL: round trip " << name << std::endl;
+		failures++;
+	}
+}
+
+template<typename T>
+void check(const char *name) {
+	for(size_t n : { 0, 1, 3, 7, 15, 16, 17, 31, 33, 64, 100, 1023, 65536+5 }) {
+		checkDecode<T>(name,n);
+		checkEncode<T>(name,n);
+	}
+}
+
+int main(int argc,char **argv) {
+	std::cout << "Kernels: " << pcm::kernel() << std::endl;
+	check<int8_t>("int8");
+	check<uint8_t>("uint8");
+	check<int16_t>("int16");
+	check<int32_t>("int32");
+
+	checkRoundTrip<int8_t>("int8",-128,127);
+	checkRoundTrip<uint8_t>("uint8",0,255);
+	checkRoundTrip<int16_t>("int16",-32768,32767);
+	checkRoundTrip<pcm::int24_t>("int24",-8388608,8388607);
+	if(failures) {
+		std::cerr << failures << " failures" << std::endl;
+		return 1;
+	}
+	std::cout << "All conversions bit-exact" << std::endl;
+	return 0;
+}
@@ -0,0 +1,40 @@
+#!/usr/bin/env python3
+'''
+Created on 17 Oct 2026
+'''
+import rubberband
+import soundfile
+import numpy
+import os
+import time
+from sys import argv
+from concurrent.futures import ThreadPoolExecutor
+
+nThreads = os.cpu_count() if len(argv)<2 else int(argv[1])
+repeats = 2
+
+data, rate = soundfile.read('slugs.wav',dtype='int16')
+stream = numpy.tile(data,8)
+ratio = 1.5
+
+def work(_):
+    return rubberband.stretch(stream,rate=rate,ratio=ratio,crispness=5,formants=False,precise=True)
+
+def timed(threads):
+    jobs = threads*repeats
+    start = time.perf_counter()
+    with ThreadPoolExecutor(max_workers=threads) as pool:
+        results = list(pool.map(work,range(jobs)))
+    elapsed = time.perf_counter()-start
+    return jobs/elapsed, results
+
+single, reference = timed(1)
+multi, results = timed(nThreads)
+
+speedup = multi/single
+print(f'1 thread : {single:.2f} calls/s')
+print(f'{nThreads} threads: {multi:.2f} calls/s')
+print(f'Speedup is {speedup:.2f} (efficiency {100*speedup/nThreads:.0f}%)')
+
+assert all(numpy.array_equal(r,reference[0]) for r in results), 'Threaded results differ'
+assert speedup > 0.7*nThreads, 'Stretching does not scale across threads'